@@ -15,6 +15,7 @@ typedef enum DreamLogLevel {
     DREAM_LOG_WARNING,
     DREAM_LOG_CRITICAL,
     DREAM_LOG_FATAL,
+    DREAM_LOG_OFF, // threshold only: silences a category but its fatals
 } DreamLogLevel;
 
 typedef enum DreamLoggerSinkTo {
@@ -23,6 +24,8 @@ typedef enum DreamLoggerSinkTo {
     DREAM_LOG_SINK_FILE        = 1 << 2,
     DREAM_LOG_SINK_RING_BUFFER = 1 << 3,
     DREAM_LOG_SINK_CALLBACK    = 1 << 4,
+    DREAM_LOG_SINK_BINARY      = 1 << 5, // decode with dream-logcat
+    DREAM_LOG_SINK_SHM         = 1 << 6, // read with dream-logcollect
 } DreamLoggerSinkTo;
 
 typedef struct DreamLoggerSink DreamLoggerSink;
@@ -31,8 +34,16 @@ typedef void (*DreamSinkWriteFn)(DreamLoggerSink *sink, const DreamLogMsg *log);
 struct DreamLoggerSink {
     DreamLoggerSinkTo sink_into;
     DreamLogLevel min_level;
+    // Async mode: the sink gets its own thread, fed by the worker through a
+    // private backlog of backlog_bytes (0: 256 KiB), so a slow sink only
+    // holds up itself. Records that find its backlog full are dropped and
+    // counted, see DreamLoggerGetSinkStats. An isolated stdout, stderr or
+    // file sink must be the only sink writing there.
+    bool isolated;
+    uint32_t backlog_bytes;
     // DreamLogFormatTokens format[4];
     DreamSinkWriteFn __write;
+    struct DreamLogSinkWorker *__worker;
 };
 
 typedef enum DreamLogAsyncOverflowPolicy {
@@ -41,6 +52,28 @@ typedef enum DreamLogAsyncOverflowPolicy {
     DROP_NEWEST,
 } DreamLogAsyncOverflowPolicy;
 
+// When a memory-mapped log file is forced to disk. Without a sync, written
+// lines still survive a crash of the process, just not of the machine.
+typedef enum DreamLogFileSync {
+    DREAM_LOG_FILE_SYNC_NONE,     // kernel writeback only
+    DREAM_LOG_FILE_SYNC_INTERVAL, // every logfile_sync_interval_ms
+    DREAM_LOG_FILE_SYNC_LEVEL,    // also after lines >= logfile_sync_level
+} DreamLogFileSync;
+
+typedef enum DreamLogDrainOrder {
+    DREAM_LOG_DRAIN_ROUND_ROBIN,
+    DREAM_LOG_DRAIN_TIMESTAMP,
+} DreamLogDrainOrder;
+
+// Clock used to timestamp log calls. TSC needs an invariant TSC and async
+// mode, otherwise CLOCK_MONOTONIC is used; DreamLoggerInit takes 20 ms
+// longer to calibrate it.
+typedef enum DreamLogClock {
+    DREAM_LOG_CLOCK_MONOTONIC,
+    DREAM_LOG_CLOCK_MONOTONIC_COARSE,
+    DREAM_LOG_CLOCK_TSC,
+} DreamLogClock;
+
 typedef void (*DreamLogCallbackFn)(
     DreamLogLevel level,
     const char *category,
@@ -51,28 +84,176 @@ typedef void (*DreamLogCallbackFn)(
 
 typedef uint8_t DreamLogSinksBitmask;
 
+// Categories are interned once per process; ids stay valid across logger
+// restarts.
+#define DREAM_LOG_MAX_CATEGORIES 256
+typedef uint16_t DreamLogCategoryId;
+
+typedef struct DreamLogCategoryLevel {
+    const char *category;
+    DreamLogLevel min_level;
+} DreamLogCategoryLevel;
+
 typedef struct DreamLoggerConfig {
     bool enabled;
     bool use_color;
     bool use_emoji;
     bool show_time;
     bool show_thread;
+    DreamLogClock clock;
     DreamLogLevel global_min_log_level;
+    // Starting levels for named categories; all others start at
+    // global_min_log_level. Change them later with DreamLogSetCategoryLevel.
+    const DreamLogCategoryLevel *category_levels;
+    uint16_t category_level_count;
     DreamLoggerSink **sinks;
     uint16_t sink_count;
     const char *logfile_path;
+    // With logfile_segment_bytes set, the file sink writes into a
+    // preallocated segment of that size mapped into memory instead of
+    // calling write(). The file rotates when the segment is full or older
+    // than logfile_max_age_s (0: no limit): path becomes path.1 and so on,
+    // keeping logfile_keep_count old files. A log left by a previous run is
+    // rotated the same way on init.
+    uint64_t logfile_segment_bytes;
+    uint32_t logfile_max_age_s;
+    uint32_t logfile_keep_count;
+    DreamLogFileSync logfile_sync;
+    uint32_t logfile_sync_interval_ms; // 0: 1000
+    DreamLogLevel logfile_sync_level;
+    // Needs async_deferred_format to store format ids instead of text.
+    const char *binary_logfile_path;
 
     uint32_t ring_buffer_lines;
     uint32_t ring_buffer_line_len;
+    // Flight recorder file: the ring lives in this file, mapped shared, so
+    // its lines survive a crash of the process (read them back with
+    // DreamLoggerDumpRingFile or dream-logcat). The previous run's ring is
+    // renamed to <path>.prev on init. Without a path the ring is in memory.
+    const char *ring_buffer_path;
+
+    // DREAM_LOG_SINK_SHM: records go into a shared-memory ring of shm_bytes
+    // (0: 1 MiB) named shm_name (nullptr: "/dream-log.<pid>"), for
+    // dream-logcollect to merge with other processes' and write out. A ring
+    // the collector has not read to the end is left behind on shutdown for
+    // it to pick up. Records it does not keep up with are dropped; the
+    // process never waits for it. A name still in use by a live process, or
+    // holding records the collector has not read, is left alone and the
+    // ring is created as <name>.1, <name>.2 and so on instead.
+    const char *shm_name;
+    uint32_t shm_bytes;
+
+    // Catches SIGSEGV, SIGBUS, SIGABRT, SIGFPE and SIGILL, writes the records
+    // still queued and the ring buffer to stderr and the log file, then
+    // passes the signal on to the handler that was there before. The
+    // handler runs on a per-thread signal stack so it survives a stack
+    // overflow; the init thread and the logger's own threads get one, other
+    // threads call DreamLoggerInstallSignalStack when they start.
+    bool crash_handler;
+
+    // Profiling zones (DREAM_ZONE) go to profile_path as Chrome trace JSON,
+    // which chrome://tracing and ui.perfetto.dev open. Each thread records
+    // into a buffer of profile_thread_bytes (0: 256 KiB) that a background
+    // thread empties every profile_flush_ms (0: 20); zones that find it
+    // full are dropped and counted at the end of the file. Without a path
+    // zones cost one relaxed load.
+    const char *profile_path;
+    uint32_t profile_thread_bytes;
+    uint32_t profile_flush_ms;
 
     DreamLogCallbackFn callback;
     void *callback_user_data;
 
+    // Storm suppression for the log macros, tracked per call site. A site
+    // may log rate_limit_burst lines (0: rate_limit_per_sec) at once and
+    // rate_limit_per_sec lines a second on average; the rest are dropped
+    // before formatting and their count is logged with the site's next line.
+    // 0 disables. collapse_repeats drops lines identical to the site's
+    // previous one and logs "last message repeated N times" when the text
+    // changes or, on the next repeat, once collapse_window_ms (0: 1000) has
+    // passed. Fatal lines are never suppressed.
+    uint32_t rate_limit_per_sec;
+    uint32_t rate_limit_burst;
+    bool collapse_repeats;
+    uint32_t collapse_window_ms;
+
     bool async;
-    size_t async_queue_capacity; // no of DreamLogMsg elements
+    size_t async_queue_capacity; // no of short log records
+    size_t async_queue_bytes;    // queue size in bytes, overrides capacity
     DreamLogAsyncOverflowPolicy async_log_overflow_policy;
+    // Capture the raw printf arguments on the calling thread and run the
+    // formatting on the async worker. The format string must outlive the
+    // logger (string literals are fine).
+    bool async_deferred_format;
+    // Give every logging thread its own queue instead of sharing one. The
+    // overflow policy applies per thread.
+    bool async_per_thread_queues;
+    size_t async_thread_queue_bytes; // 0: 64 KiB
+    // TIMESTAMP merges the queues by call time instead of draining each
+    // in turn.
+    DreamLogDrainOrder async_drain_order;
+    // Worker wakeup: once out of work the worker spins async_spin_count
+    // times before parking. A parked worker is woken early when a queue is
+    // async_wake_fill_percent full, otherwise records wait at most about
+    // async_wake_latency_us. 0 picks the defaults (1000, 50, 1000).
+    uint32_t async_spin_count;
+    uint32_t async_wake_fill_percent;
+    uint32_t async_wake_latency_us;
+    // The worker buffers stdout/stderr/file output and writes it once per
+    // batch. A batch holding a record at or above async_flush_level is
+    // written at once; otherwise output waits at most
+    // async_flush_interval_ms (0: 50) or until the worker goes idle.
+    // async_flush_level is DREAM_LOG_WARNING unless async_flush_level_set.
+    DreamLogLevel async_flush_level;
+    bool async_flush_level_set;
+    uint32_t async_flush_interval_ms;
+    uint32_t sink_buffer_bytes; // per output, 0: 64 KiB
+    // Linux: the worker hands file output to io_uring with up to
+    // async_file_uring_buffers (0: 4) buffers of sink_buffer_bytes in
+    // flight, so it only waits for the disk when all of them are. Falls back
+    // to write() where io_uring is unavailable; ignored with
+    // logfile_segment_bytes.
+    bool async_file_uring;
+    uint32_t async_file_uring_buffers;
 } DreamLoggerConfig;
 
+// Enqueue-to-sink latency buckets: 8 per power of two (each at most 12.5%
+// wide) from 0 ns to about 69 s; the last bucket also takes anything slower.
+#define DREAM_LOG_LATENCY_BUCKETS 280
+
+// Counters of the async queues since DreamLoggerInit, summed over the shared
+// and per-thread queues. Reading them costs about as much as a memcpy.
+typedef struct DreamLoggerStats {
+    uint64_t enqueued;       // records accepted into a queue
+    uint64_t dropped_newest; // DROP_NEWEST: records refused by a full queue
+    uint64_t dropped_oldest; // DROP_OLDEST: queued records thrown out
+    uint64_t blocked;        // BLOCK: pushes that had to wait for room
+    uint64_t blocked_ns;     // total time those producers waited
+    uint64_t written;        // records handed to the sinks by the worker
+    uint32_t queue_high_water_percent; // fullest any queue has been seen
+    uint64_t queue_high_water_bytes;   // the same, in bytes of that queue
+    uint64_t latency_max_ns;
+    uint64_t latency_buckets[DREAM_LOG_LATENCY_BUCKETS];
+} DreamLoggerStats;
+
+// A profiling zone in progress, see DREAM_ZONE. `name` is recorded by
+// address and must outlive the logger (a string literal in practice).
+typedef struct DreamZone {
+    const char *name; // nullptr: not profiling
+    uint64_t start;
+} DreamZone;
+
+// Counters of an isolated sink's backlog since DreamLoggerInit.
+typedef struct DreamLoggerSinkStats {
+    uint64_t enqueued; // records handed to the sink's thread
+    uint64_t dropped;  // records that found its backlog full
+    uint64_t written;  // records the sink has written
+    uint32_t backlog_high_water_percent;
+} DreamLoggerSinkStats;
+
+// Every allocation the foundation makes goes to `alloc`, which must be
+// thread-safe and return memory aligned to `alignment` (a power of two).
+// Large buffers, such as the async log queue, ask for page alignment.
 typedef void *(*DreamUserAllocFn)(
     size_t size, size_t alignment, void *user_data
 );
@@ -84,6 +265,25 @@ typedef struct DreamUserAllocator {
     void *user_data;
 } DreamUserAllocator;
 
+// Subsystems whose memory DreamGetMemoryStats reports separately.
+typedef enum DreamMemoryTag {
+    DREAM_MEMORY_LOGGER,
+    DREAM_MEMORY_WINDOW,
+    DREAM_MEMORY_INPUT,
+    DREAM_MEMORY_AUDIO,
+    DREAM_MEMORY_FRAME, // DreamFrameAlloc arenas
+    DREAM_MEMORY_POOL,  // DreamPool blocks
+    DREAM_MEMORY_TAG_COUNT,
+} DreamMemoryTag;
+
+typedef struct DreamMemoryStats {
+    uint64_t bytes; // live, as requested
+    uint64_t peak_bytes;
+    uint64_t allocations; // live
+    uint64_t total_allocations;
+    uint64_t failed;
+} DreamMemoryStats;
+
 typedef struct DreamConfig {
     bool enable_logging;
     const DreamLoggerConfig *loggerConfig;
@@ -97,6 +297,58 @@ typedef struct DreamConfig {
 bool DreamInit(const DreamConfig *config);
 void DreamShutdown();
 
+// Counters since the process started, whichever allocator was in use.
+void DreamGetMemoryStats(DreamMemoryTag tag, DreamMemoryStats *out);
+
+// Runtime per-category log levels, e.g. turn on "DreamWindow" tracing in a
+// live session. DREAM_LOG_OFF silences a category except for fatal lines,
+// which still trap.
+void DreamLogSetCategoryLevel(const char *category, DreamLogLevel level);
+DreamLogLevel DreamLogGetCategoryLevel(const char *category);
+
+// Logger self-metrics for telemetry export; all zero without async logging.
+void DreamLoggerGetStats(DreamLoggerStats *out);
+// Lower bound of a latency bucket in ns.
+uint64_t DreamLoggerLatencyBucketNs(uint32_t bucket);
+// Latency below which `percentile` (0-100) of the records were written,
+// rounded up to a bucket bound.
+uint64_t
+DreamLoggerLatencyPercentile(const DreamLoggerStats *stats, double percentile);
+// All zero for a sink that is not isolated.
+void DreamLoggerGetSinkStats(
+    const DreamLoggerSink *sink, DreamLoggerSinkStats *out
+);
+
+#if !defined(REMOVE_DREAM_LOGGER)
+// Gives the calling thread a signal stack for the crash handler unless it
+// already has one. Does nothing when crash_handler is off.
+void DreamLoggerInstallSignalStack(void);
+
+// Zones are recorded when they end. Prefer the DREAM_ZONE macros.
+DreamZone DreamZoneBegin(const char *name);
+void DreamZoneEnd(DreamZone *zone);
+
+// DREAM_ZONE(name) profiles the rest of the enclosing scope (GCC and Clang
+// only); DREAM_ZONE_BEGIN/END bracket any stretch of code in one function.
+#define DREAM_ZONE_BEGIN(zone, name) DreamZone zone = DreamZoneBegin(name)
+#define DREAM_ZONE_END(zone)         DreamZoneEnd(&(zone))
+#if defined(__GNUC__)
+#define DREAM_ZONE_CAT_(a, b) a##b
+#define DREAM_ZONE_CAT(a, b)  DREAM_ZONE_CAT_(a, b)
+#define DREAM_ZONE(name)                                                     \
+    DreamZone DREAM_ZONE_CAT(dream_zone_, __LINE__)                          \
+        __attribute__((cleanup(DreamZoneEnd))) = DreamZoneBegin(name)
+#endif
+
+#else
+#define DreamLoggerInstallSignalStack() ((void)0)
+// The zone variable still exists so code between BEGIN and END that names
+// it compiles; it is never recorded.
+#define DREAM_ZONE_BEGIN(zone, name) DreamZone zone = {0}
+#define DREAM_ZONE_END(zone)         ((void)(zone))
+#define DREAM_ZONE(name)
+#endif // !REMOVE_DREAM_LOGGER
+
 #ifdef __cplusplus
 }
 #endif
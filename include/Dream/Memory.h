@@ -0,0 +1,78 @@
+#ifndef DREAM_MEMORY_PUBLIC_API
+#define DREAM_MEMORY_PUBLIC_API
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#define DREAM_ALIGNOF(type) alignof(type)
+#else
+#define DREAM_ALIGNOF(type) _Alignof(type)
+#endif
+
+// Frame memory. Every thread bump-allocates from its own arena, so
+// allocating takes no lock, and nothing is freed one by one: the memory
+// stays valid until the frame ends, then the whole arena is reused.
+// `alignment` is a power of two, 0 for malloc's. Returns nullptr when out
+// of memory.
+void *DreamFrameAlloc(size_t size, size_t alignment);
+
+// Ends the frame for every thread, e.g. once onFrameDone has returned.
+// Each arena is rewound the next time its thread calls DreamFrameAlloc;
+// an arena that needed several chunks during the frame comes back as one.
+void DreamFrameEnd(void);
+
+// Number of DreamFrameEnd calls so far.
+uint64_t DreamFrameIndex(void);
+
+// Gives the calling thread's arena back; what it allocated from it is
+// gone. A thread's arena is released when it exits, and DreamShutdown
+// releases the arena of the thread calling it. Other threads that used
+// DreamFrameAlloc under a custom allocator must exit or call this before
+// DreamShutdown, so nothing is handed back to an allocator already torn
+// down.
+void DreamFrameRelease(void);
+
+#define DREAM_FRAME_NEW(type, count)                                         \
+    ((type *)DreamFrameAlloc(sizeof(type) * (count), DREAM_ALIGNOF(type)))
+
+// Pools of fixed-size objects. Each thread keeps a cache of free objects
+// for every pool it uses and only takes the pool's lock to move a batch in
+// or out of it. An object may be freed on any thread. The memory of a pool
+// comes from the allocator installed when it was created and is only given
+// back by DreamPoolDestroy, which must not race with other calls on the
+// same pool. Destroy pools before DreamShutdown.
+typedef struct DreamPool DreamPool;
+
+DreamPool *DreamPoolCreate(size_t object_size, size_t alignment);
+void DreamPoolDestroy(DreamPool *pool);
+void *DreamPoolAlloc(DreamPool *pool);
+void DreamPoolFree(DreamPool *pool, void *object);
+
+// Typed wrappers: DREAM_POOL_TYPE(Particle) declares ParticlePool with
+// ParticlePoolCreate, ParticlePoolAlloc, ParticlePoolFree and
+// ParticlePoolDestroy.
+#define DREAM_POOL_TYPE(type)                                                \
+    typedef struct type##Pool {                                              \
+        DreamPool *pool;                                                     \
+    } type##Pool;                                                            \
+    static inline type##Pool type##PoolCreate(void) {                        \
+        type##Pool p = {DreamPoolCreate(sizeof(type), DREAM_ALIGNOF(type))}; \
+        return p;                                                            \
+    }                                                                        \
+    static inline type *type##PoolAlloc(type##Pool p) {                      \
+        return (type *)DreamPoolAlloc(p.pool);                               \
+    }                                                                        \
+    static inline void type##PoolFree(type##Pool p, type *object) {          \
+        DreamPoolFree(p.pool, object);                                       \
+    }                                                                        \
+    static inline void type##PoolDestroy(type##Pool p) {                     \
+        DreamPoolDestroy(p.pool);                                            \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !DREAM_MEMORY_PUBLIC_API
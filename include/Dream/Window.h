@@ -44,6 +44,26 @@ typedef struct DreamWindowDesc {
     void *user_data;
 } DreamWindowDesc;
 
+typedef enum DreamEventKind {
+    DREAM_EVENT_KEY_PRESS,
+    DREAM_EVENT_KEY_RELEASE,
+    DREAM_EVENT_MOUSE_BTN_PRESS,
+    DREAM_EVENT_MOUSE_BTN_RELEASE,
+    DREAM_EVENT_MOUSE_MOVE,       // to x, y, by dx, dy
+    DREAM_EVENT_MOUSE_RAW_MOTION, // dx, dy before acceleration
+    DREAM_EVENT_MOUSE_SCROLL,     // dy is the amount, up is positive
+} DreamEventKind;
+
+// One input event, as DreamDrainEvents hands it out. x, y is where the
+// pointer was when it happened.
+typedef struct DreamEvent {
+    DreamEventKind kind;
+    uint32_t time; // X server time, ms
+    uint16_t code; // KeyCode or MouseButtonCode
+    float x, y;
+    float dx, dy;
+} DreamEvent;
+
 DreamWindowDesc DreamDefaultWindowDescriptor();
 
 DreamWindow *DreamWindowCreate(const DreamWindowDesc *desc);
@@ -61,6 +81,14 @@ void DreamSetPointerLock(DreamWindow *window, bool flag);
 void DreamSetPointerVisibility(DreamWindow *window, bool flag);
 void DreamEnableRawMouseMotion(bool flag);
 
+// Pumps the platform's events on a thread of the foundation instead of in
+// DreamPollEvents, so input is sampled even while the caller blocks on
+// swap. Callbacks then run on that thread; DreamPollEvents no longer
+// reads events. If the connection to the display is lost the thread ends
+// and DreamPollEvents pumps again. Returns false if the platform cannot
+// pump on a thread.
+bool DreamSetInputThread(bool enabled);
+
 void DreamPollEvents(DreamWindow *window);
 void DreamWaitForEvent(DreamWindow *window);
 void DreamWaitForEventTill(DreamWindow *window, double timeout);
@@ -68,8 +96,19 @@ void DreamWindowRegisterCallbacks(
     DreamWindow *window, const DreamWindowCallbacks *callbacks
 );
 
+// Every input event since the last drain, oldest first, in addition to
+// the callbacks and the latest-state queries below. Copies up to `max`
+// events into `out` and returns how many; call again while it returns
+// `max`. A window queues up to DREAM_EVENT_QUEUE_CAPACITY events; newer
+// ones are dropped and counted until it is drained.
+#define DREAM_EVENT_QUEUE_CAPACITY 1024
+uint32_t DreamDrainEvents(DreamWindow *window, DreamEvent *out, uint32_t max);
+uint64_t DreamGetDroppedEventCount(DreamWindow *window);
+
 bool DreamWindowShouldClose(DreamWindow *window);
 
+// The state queries below read the input state as last published by the
+// event pump, consistent as a whole, and may be called from any thread.
 KeyState DreamGetKeyState(DreamWindow *window, KeyCode key);
 KeyState DreamGetMouseBtnState(DreamWindow *window, MouseButtonCode key);
 
@@ -0,0 +1,241 @@
+#include "Allocator.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Platform.h"
+
+#if defined(DREAM_PLATFORM_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// One cache line per subsystem, so threads of different subsystems do not
+// share the counters they bump.
+typedef struct DreamMemoryCounters {
+    alignas(64) _Atomic uint64_t bytes;
+    _Atomic uint64_t peak_bytes;
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t total_allocations;
+    _Atomic uint64_t failed;
+} DreamMemoryCounters;
+
+static DreamUserAllocator g_dream_allocator; // alloc == nullptr: built-in
+static DreamMemoryCounters g_dream_memory[DREAM_MEMORY_TAG_COUNT];
+
+void _dream_memory_set_allocator(const DreamUserAllocator *allocator) {
+    if (allocator && allocator->alloc && allocator->free)
+        g_dream_allocator = *allocator;
+    else
+        g_dream_allocator = (DreamUserAllocator){0};
+}
+
+static void dream_memory_count(DreamMemoryTag tag, void *ptr, size_t size) {
+    DreamMemoryCounters *c = &g_dream_memory[tag];
+    if (!ptr) {
+        atomic_fetch_add_explicit(&c->failed, 1, memory_order_relaxed);
+        return;
+    }
+    uint64_t bytes =
+        atomic_fetch_add_explicit(&c->bytes, size, memory_order_relaxed) +
+        size;
+    uint64_t peak = atomic_load_explicit(&c->peak_bytes, memory_order_relaxed);
+    while (peak < bytes && !atomic_compare_exchange_weak_explicit(
+                               &c->peak_bytes,
+                               &peak,
+                               bytes,
+                               memory_order_relaxed,
+                               memory_order_relaxed
+                           )) {
+    }
+    atomic_fetch_add_explicit(&c->allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->total_allocations, 1, memory_order_relaxed);
+}
+
+static void dream_memory_uncount(DreamMemoryTag tag, size_t size) {
+    DreamMemoryCounters *c = &g_dream_memory[tag];
+    atomic_fetch_sub_explicit(&c->bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&c->allocations, 1, memory_order_relaxed);
+}
+
+void _dream_memory_allocator(DreamUserAllocator *out) {
+    *out = g_dream_allocator;
+}
+
+void *_dream_alloc_with(
+    const DreamUserAllocator *allocator,
+    DreamMemoryTag tag,
+    size_t size,
+    size_t alignment
+) {
+    void *ptr;
+    if (allocator->alloc) {
+        ptr = allocator->alloc(
+            size,
+            alignment ? alignment : alignof(max_align_t),
+            allocator->user_data
+        );
+    } else if (alignment <= alignof(max_align_t)) {
+        ptr = malloc(size);
+    } else {
+        // aligned_alloc wants a multiple of the alignment.
+        ptr = aligned_alloc(
+            alignment, (size + alignment - 1) & ~(alignment - 1)
+        );
+    }
+    dream_memory_count(tag, ptr, size);
+    return ptr;
+}
+
+void *_dream_alloc(DreamMemoryTag tag, size_t size, size_t alignment) {
+    return _dream_alloc_with(&g_dream_allocator, tag, size, alignment);
+}
+
+void *_dream_calloc(DreamMemoryTag tag, size_t size, size_t alignment) {
+    if (!g_dream_allocator.alloc && alignment <= alignof(max_align_t)) {
+        void *ptr = calloc(1, size);
+        dream_memory_count(tag, ptr, size);
+        return ptr;
+    }
+    void *ptr = _dream_alloc(tag, size, alignment);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+void _dream_free_with(
+    const DreamUserAllocator *allocator,
+    DreamMemoryTag tag,
+    void *ptr,
+    size_t size
+) {
+    if (!ptr) return;
+    dream_memory_uncount(tag, size);
+    if (allocator->free)
+        allocator->free(ptr, allocator->user_data);
+    else
+        free(ptr);
+}
+
+void _dream_free(DreamMemoryTag tag, void *ptr, size_t size) {
+    _dream_free_with(&g_dream_allocator, tag, ptr, size);
+}
+
+char *_dream_strdup(DreamMemoryTag tag, const char *s) {
+    size_t size = strlen(s) + 1;
+    char *copy  = _dream_alloc(tag, size, 0);
+    if (copy) memcpy(copy, s, size);
+    return copy;
+}
+
+void _dream_free_str(DreamMemoryTag tag, char *s) {
+    if (s) _dream_free(tag, s, strlen(s) + 1);
+}
+
+static size_t dream_page_size(void) {
+#if defined(DREAM_PLATFORM_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Mapped length of a page allocation, known again when it is freed.
+static size_t dream_pages_length(size_t size) {
+    size_t unit = size >= DREAM_MEMORY_HUGE_PAGE ? DREAM_MEMORY_HUGE_PAGE
+                                                 : dream_page_size();
+    return (size + unit - 1) & ~(unit - 1);
+}
+
+void *_dream_alloc_pages_with(
+    const DreamUserAllocator *allocator, DreamMemoryTag tag, size_t size
+) {
+    size_t length = dream_pages_length(size);
+    void *ptr     = nullptr;
+    if (allocator->alloc) {
+        ptr = allocator->alloc(length, dream_page_size(), allocator->user_data);
+        if (ptr) memset(ptr, 0, length);
+    } else {
+#if defined(DREAM_PLATFORM_WIN32)
+        ptr = VirtualAlloc(
+            nullptr, length, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE
+        );
+#else
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_HUGETLB)
+        // Only succeeds if huge pages were reserved (vm.nr_hugepages).
+        if (length >= DREAM_MEMORY_HUGE_PAGE) {
+            ptr = mmap(
+                nullptr,
+                length,
+                PROT_READ | PROT_WRITE,
+                flags | MAP_HUGETLB,
+                -1,
+                0
+            );
+            if (ptr == MAP_FAILED) ptr = nullptr;
+        }
+#endif
+        if (!ptr) {
+            ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (ptr == MAP_FAILED) {
+                ptr = nullptr;
+            } else {
+#if defined(MADV_HUGEPAGE)
+                if (length >= DREAM_MEMORY_HUGE_PAGE)
+                    madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+            }
+        }
+#endif
+    }
+    dream_memory_count(tag, ptr, size);
+    return ptr;
+}
+
+void *_dream_alloc_pages(DreamMemoryTag tag, size_t size) {
+    return _dream_alloc_pages_with(&g_dream_allocator, tag, size);
+}
+
+void _dream_free_pages_with(
+    const DreamUserAllocator *allocator,
+    DreamMemoryTag tag,
+    void *ptr,
+    size_t size
+) {
+    if (!ptr) return;
+    dream_memory_uncount(tag, size);
+    if (allocator->free) {
+        allocator->free(ptr, allocator->user_data);
+        return;
+    }
+#if defined(DREAM_PLATFORM_WIN32)
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, dream_pages_length(size));
+#endif
+}
+
+void _dream_free_pages(DreamMemoryTag tag, void *ptr, size_t size) {
+    _dream_free_pages_with(&g_dream_allocator, tag, ptr, size);
+}
+
+void DreamGetMemoryStats(DreamMemoryTag tag, DreamMemoryStats *out) {
+    *out = (DreamMemoryStats){0};
+    if ((unsigned)tag >= DREAM_MEMORY_TAG_COUNT) return;
+    DreamMemoryCounters *c = &g_dream_memory[tag];
+    out->bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+    out->peak_bytes =
+        atomic_load_explicit(&c->peak_bytes, memory_order_relaxed);
+    out->allocations =
+        atomic_load_explicit(&c->allocations, memory_order_relaxed);
+    out->total_allocations =
+        atomic_load_explicit(&c->total_allocations, memory_order_relaxed);
+    out->failed = atomic_load_explicit(&c->failed, memory_order_relaxed);
+}
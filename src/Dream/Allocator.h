@@ -0,0 +1,94 @@
+#ifndef DREAM_INTERNAL_ALLOCATOR
+#define DREAM_INTERNAL_ALLOCATOR
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every allocation the foundation makes goes through here, to the
+// DreamUserAllocator given to DreamInit or to the built-in one, and is
+// counted against the subsystem that made it.
+
+// The public types are mirrored from Dream.h for the sources that do not
+// include it.
+#if !defined(DREAM_PUBLIC_API)
+typedef void *(*DreamUserAllocFn)(
+    size_t size, size_t alignment, void *user_data
+);
+typedef void (*DreamUserFreeFn)(void *ptr, void *user_data);
+
+typedef struct DreamUserAllocator {
+    DreamUserAllocFn alloc;
+    DreamUserFreeFn free;
+    void *user_data;
+} DreamUserAllocator;
+
+typedef enum DreamMemoryTag {
+    DREAM_MEMORY_LOGGER,
+    DREAM_MEMORY_WINDOW,
+    DREAM_MEMORY_INPUT,
+    DREAM_MEMORY_AUDIO,
+    DREAM_MEMORY_FRAME, // DreamFrameAlloc arenas
+    DREAM_MEMORY_POOL,  // DreamPool blocks
+    DREAM_MEMORY_TAG_COUNT,
+} DreamMemoryTag;
+
+typedef struct DreamMemoryStats {
+    uint64_t bytes; // live, as requested
+    uint64_t peak_bytes;
+    uint64_t allocations; // live
+    uint64_t total_allocations;
+    uint64_t failed;
+} DreamMemoryStats;
+#endif
+
+void DreamGetMemoryStats(DreamMemoryTag tag, DreamMemoryStats *out);
+
+#define DREAM_MEMORY_HUGE_PAGE (2u * 1024 * 1024)
+
+// Installs `allocator` (nullptr: the built-in one) for the allocations
+// that follow. Whatever was allocated before must be freed first; the
+// counters are kept.
+void _dream_memory_set_allocator(const DreamUserAllocator *allocator);
+
+// `alignment` is a power of two, 0 for malloc's. Returns nullptr on
+// failure. _dream_free needs the size that was asked for.
+void *_dream_alloc(DreamMemoryTag tag, size_t size, size_t alignment);
+void *_dream_calloc(DreamMemoryTag tag, size_t size, size_t alignment);
+void _dream_free(DreamMemoryTag tag, void *ptr, size_t size);
+char *_dream_strdup(DreamMemoryTag tag, const char *s);
+void _dream_free_str(DreamMemoryTag tag, char *s);
+
+// Zeroed, page-aligned memory for large buffers. The built-in allocator
+// maps it directly, from huge pages when it is at least
+// DREAM_MEMORY_HUGE_PAGE and the system has some to spare, otherwise
+// asking for transparent huge pages.
+void *_dream_alloc_pages(DreamMemoryTag tag, size_t size);
+void _dream_free_pages(DreamMemoryTag tag, void *ptr, size_t size);
+
+// For memory that may outlive the allocator installed now: keep the one
+// _dream_memory_allocator returns ({0}: built-in) next to it and allocate
+// and free through that.
+void _dream_memory_allocator(DreamUserAllocator *out);
+void *_dream_alloc_with(
+    const DreamUserAllocator *allocator,
+    DreamMemoryTag tag,
+    size_t size,
+    size_t alignment
+);
+void _dream_free_with(
+    const DreamUserAllocator *allocator,
+    DreamMemoryTag tag,
+    void *ptr,
+    size_t size
+);
+void *_dream_alloc_pages_with(
+    const DreamUserAllocator *allocator, DreamMemoryTag tag, size_t size
+);
+void _dream_free_pages_with(
+    const DreamUserAllocator *allocator,
+    DreamMemoryTag tag,
+    void *ptr,
+    size_t size
+);
+
+#endif // !DREAM_INTERNAL_ALLOCATOR
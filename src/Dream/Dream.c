@@ -0,0 +1,45 @@
+#include <Dream/Dream.h>
+#include <Dream/Memory.h>
+
+#include "Allocator.h"
+
+// Logger.h mirrors the types above, so the two are not included together.
+void DreamLoggerInit(const DreamLoggerConfig *config);
+void DreamLoggerShutdown(void);
+
+static struct {
+    bool initialized;
+    bool logging;
+} g_dream;
+
+bool DreamInit(const DreamConfig *config) {
+    if (g_dream.initialized) return false;
+    if (config->use_custom_allocator &&
+        (!config->allocator || !config->allocator->alloc ||
+         !config->allocator->free))
+        return false;
+
+    // Before any subsystem allocates.
+    _dream_memory_set_allocator(
+        config->use_custom_allocator ? config->allocator : nullptr
+    );
+#if !defined(REMOVE_DREAM_LOGGER)
+    if (config->enable_logging && config->loggerConfig) {
+        DreamLoggerInit(config->loggerConfig);
+        g_dream.logging = true;
+    }
+#endif
+    g_dream.initialized = true;
+    return true;
+}
+
+void DreamShutdown() {
+    if (!g_dream.initialized) return;
+#if !defined(REMOVE_DREAM_LOGGER)
+    if (g_dream.logging) DreamLoggerShutdown();
+#endif
+    g_dream.logging     = false;
+    g_dream.initialized = false;
+    DreamFrameRelease();
+    _dream_memory_set_allocator(nullptr);
+}
@@ -0,0 +1,510 @@
+#include "LogFormat.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Deferred formatting: the producer walks the format string once and copies
+// each argument into the message buffer in its natural width. The worker
+// walks the same format string again and feeds every conversion spec to
+// snprintf with the matching argument.
+
+typedef enum DreamFmtArgKind {
+    DREAM_FMT_ARG_NONE, // "%%"
+    DREAM_FMT_ARG_INT,
+    DREAM_FMT_ARG_LONG,
+    DREAM_FMT_ARG_LLONG,
+    DREAM_FMT_ARG_INTMAX,
+    DREAM_FMT_ARG_SIZE,
+    DREAM_FMT_ARG_PTRDIFF,
+    DREAM_FMT_ARG_DOUBLE,
+    DREAM_FMT_ARG_LDOUBLE,
+    DREAM_FMT_ARG_STRING,
+    DREAM_FMT_ARG_POINTER,
+    DREAM_FMT_ARG_UNSUPPORTED,
+} DreamFmtArgKind;
+
+typedef struct DreamFmtSpec {
+    DreamFmtArgKind kind;
+    uint8_t star_count;  // '*' width/precision, each takes an int
+    bool precision_star; // precision is the last '*' argument
+    int precision;       // -1 when the spec has none
+    size_t length;       // chars of the spec, including the leading '%'
+} DreamFmtSpec;
+
+#define DREAM_FMT_MAX_SPEC 32
+// Larger precisions are clamped; no string copy can be that long anyway
+#define DREAM_FMT_MAX_PRECISION 100000000
+
+// `p` points at the '%' that starts a conversion spec.
+static DreamFmtSpec dream_fmt_parse_spec(const char *p) {
+    DreamFmtSpec spec = {.kind = DREAM_FMT_ARG_UNSUPPORTED, .precision = -1};
+    const char *s     = p + 1;
+
+    while (*s == '-' || *s == '+' || *s == ' ' || *s == '#' || *s == '0' ||
+           *s == '\'')
+        ++s;
+
+    if (*s == '*') {
+        ++spec.star_count;
+        ++s;
+    } else {
+        while (*s >= '0' && *s <= '9') ++s;
+    }
+
+    if (*s == '.') {
+        ++s;
+        if (*s == '*') {
+            ++spec.star_count;
+            spec.precision_star = true;
+            ++s;
+        } else {
+            spec.precision = 0;
+            for (; *s >= '0' && *s <= '9'; ++s)
+                if (spec.precision < DREAM_FMT_MAX_PRECISION)
+                    spec.precision = spec.precision * 10 + (*s - '0');
+        }
+    }
+
+    enum { LEN_NONE, LEN_L, LEN_LL, LEN_J, LEN_Z, LEN_T, LEN_BIG_L } len;
+    len = LEN_NONE;
+    switch (*s) {
+        case 'h':
+            s += (s[1] == 'h') ? 2 : 1; // promoted to int
+            break;
+        case 'l':
+            if (s[1] == 'l') {
+                len = LEN_LL;
+                s += 2;
+            } else {
+                len = LEN_L;
+                s += 1;
+            }
+            break;
+        case 'j': len = LEN_J; break;
+        case 'z': len = LEN_Z; break;
+        case 't': len = LEN_T; break;
+        case 'L': len = LEN_BIG_L; break;
+        default:  break;
+    }
+    if (len == LEN_J || len == LEN_Z || len == LEN_T || len == LEN_BIG_L) ++s;
+
+    switch (*s) {
+        case '%':
+            spec.kind = (s == p + 1) ? DREAM_FMT_ARG_NONE
+                                     : DREAM_FMT_ARG_UNSUPPORTED;
+            break;
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            switch (len) {
+                case LEN_NONE:  spec.kind = DREAM_FMT_ARG_INT; break;
+                case LEN_L:     spec.kind = DREAM_FMT_ARG_LONG; break;
+                case LEN_LL:    spec.kind = DREAM_FMT_ARG_LLONG; break;
+                case LEN_J:     spec.kind = DREAM_FMT_ARG_INTMAX; break;
+                case LEN_Z:     spec.kind = DREAM_FMT_ARG_SIZE; break;
+                case LEN_T:     spec.kind = DREAM_FMT_ARG_PTRDIFF; break;
+                case LEN_BIG_L: break;
+            }
+            break;
+        case 'c':
+            if (len == LEN_NONE) spec.kind = DREAM_FMT_ARG_INT;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (len == LEN_NONE || len == LEN_L)
+                spec.kind = DREAM_FMT_ARG_DOUBLE;
+            else if (len == LEN_BIG_L)
+                spec.kind = DREAM_FMT_ARG_LDOUBLE;
+            break;
+        case 's':
+            if (len == LEN_NONE) spec.kind = DREAM_FMT_ARG_STRING;
+            break;
+        case 'p':
+            if (len == LEN_NONE) spec.kind = DREAM_FMT_ARG_POINTER;
+            break;
+        default: break; // %n, wide chars, unknown conversions
+    }
+
+    spec.length = (size_t)(s - p) + (*s ? 1 : 0);
+    if (spec.length >= DREAM_FMT_MAX_SPEC)
+        spec.kind = DREAM_FMT_ARG_UNSUPPORTED;
+    return spec;
+}
+
+#define DREAM_PACK(type, promoted)                                             \
+    do {                                                                       \
+        type v = (type)va_arg(args, promoted);                                 \
+        if (used + sizeof(v) > cap) return DREAM_LOG_PACK_FAILED;              \
+        memcpy(out + used, &v, sizeof(v));                                     \
+        used += sizeof(v);                                                     \
+    } while (0)
+
+size_t
+_dream_log_pack_args(const char *fmt, va_list args, char *out, size_t cap) {
+    size_t used = 0;
+
+    for (const char *p = fmt; *p; ++p) {
+        if (*p != '%') continue;
+
+        DreamFmtSpec spec = dream_fmt_parse_spec(p);
+        p += spec.length - 1;
+
+        int star = -1;
+        for (uint8_t i = 0; i < spec.star_count; ++i) {
+            star = va_arg(args, int);
+            if (used + sizeof(star) > cap) return DREAM_LOG_PACK_FAILED;
+            memcpy(out + used, &star, sizeof(star));
+            used += sizeof(star);
+        }
+        // A negative '*' precision is taken as if it were omitted
+        if (spec.precision_star) spec.precision = (star < 0) ? -1 : star;
+
+        switch (spec.kind) {
+            case DREAM_FMT_ARG_NONE:    break;
+            case DREAM_FMT_ARG_INT:     DREAM_PACK(int, int); break;
+            case DREAM_FMT_ARG_LONG:    DREAM_PACK(long, long); break;
+            case DREAM_FMT_ARG_LLONG:   DREAM_PACK(long long, long long); break;
+            case DREAM_FMT_ARG_INTMAX:  DREAM_PACK(intmax_t, intmax_t); break;
+            case DREAM_FMT_ARG_SIZE:    DREAM_PACK(size_t, size_t); break;
+            case DREAM_FMT_ARG_PTRDIFF: DREAM_PACK(ptrdiff_t, ptrdiff_t); break;
+            case DREAM_FMT_ARG_DOUBLE:  DREAM_PACK(double, double); break;
+            case DREAM_FMT_ARG_LDOUBLE:
+                DREAM_PACK(long double, long double);
+                break;
+            case DREAM_FMT_ARG_POINTER: DREAM_PACK(void *, void *); break;
+            case DREAM_FMT_ARG_STRING: {
+                // The pointee may be gone by the time the worker runs, so
+                // strings are copied (and truncated to what still fits).
+                // Only the first `precision` chars are read: "%.*s" is how
+                // callers log buffers that are not NUL-terminated.
+                const char *str = va_arg(args, const char *);
+                if (!str) str = "(null)";
+                if (used >= cap) return DREAM_LOG_PACK_FAILED;
+                size_t max = cap - used - 1;
+                if (spec.precision >= 0 && (size_t)spec.precision < max)
+                    max = (size_t)spec.precision;
+                size_t n = strnlen(str, max);
+                memcpy(out + used, str, n);
+                out[used + n] = '\0';
+                used += n + 1;
+                break;
+            }
+            case DREAM_FMT_ARG_UNSUPPORTED: return DREAM_LOG_PACK_FAILED;
+        }
+    }
+
+    return used;
+}
+
+#undef DREAM_PACK
+
+#define DREAM_FORMAT_AS(type)                                                  \
+    do {                                                                       \
+        type v;                                                                \
+        if (used + sizeof(v) > args_size) goto truncated;                      \
+        memcpy(&v, args + used, sizeof(v));                                    \
+        used += sizeof(v);                                                     \
+        n = snprintf(dst, rem, spec_buf, v);                                   \
+    } while (0)
+
+void _dream_log_format_packed(
+    const char *fmt,
+    const char *args,
+    size_t args_size,
+    char *out,
+    size_t out_size
+) {
+    size_t used   = 0;
+    size_t offset = 0;
+
+    for (const char *p = fmt; *p && offset + 1 < out_size; ++p) {
+        if (*p != '%') {
+            out[offset++] = *p;
+            continue;
+        }
+
+        DreamFmtSpec spec = dream_fmt_parse_spec(p);
+
+        // Bake '*' width/precision into the spec so every conversion below
+        // is a single-argument snprintf.
+        char spec_buf[DREAM_FMT_MAX_SPEC + 2 * 12];
+        size_t spec_len = 0;
+        for (size_t i = 0; i < spec.length; ++i) {
+            if (p[i] == '*') {
+                int star;
+                if (used + sizeof(star) > args_size) goto truncated;
+                memcpy(&star, args + used, sizeof(star));
+                used += sizeof(star);
+                // "%.-1s" is not a spec; a negative precision means none
+                if (star < 0 && i > 0 && p[i - 1] == '.') {
+                    --spec_len;
+                    continue;
+                }
+                spec_len += snprintf(
+                    spec_buf + spec_len, sizeof(spec_buf) - spec_len, "%d", star
+                );
+            } else {
+                spec_buf[spec_len++] = p[i];
+            }
+        }
+        spec_buf[spec_len] = '\0';
+        p += spec.length - 1;
+
+        char *dst  = out + offset;
+        size_t rem = out_size - offset;
+        int n      = 0;
+        switch (spec.kind) {
+            case DREAM_FMT_ARG_NONE:    n = snprintf(dst, rem, "%%"); break;
+            case DREAM_FMT_ARG_INT:     DREAM_FORMAT_AS(int); break;
+            case DREAM_FMT_ARG_LONG:    DREAM_FORMAT_AS(long); break;
+            case DREAM_FMT_ARG_LLONG:   DREAM_FORMAT_AS(long long); break;
+            case DREAM_FMT_ARG_INTMAX:  DREAM_FORMAT_AS(intmax_t); break;
+            case DREAM_FMT_ARG_SIZE:    DREAM_FORMAT_AS(size_t); break;
+            case DREAM_FMT_ARG_PTRDIFF: DREAM_FORMAT_AS(ptrdiff_t); break;
+            case DREAM_FMT_ARG_DOUBLE:  DREAM_FORMAT_AS(double); break;
+            case DREAM_FMT_ARG_LDOUBLE: DREAM_FORMAT_AS(long double); break;
+            case DREAM_FMT_ARG_POINTER: DREAM_FORMAT_AS(void *); break;
+            case DREAM_FMT_ARG_STRING: {
+                if (used >= args_size) goto truncated;
+                const char *str = args + used;
+                used += strnlen(str, args_size - used) + 1;
+                n = snprintf(dst, rem, spec_buf, str);
+                break;
+            }
+            case DREAM_FMT_ARG_UNSUPPORTED: break; // rejected by the producer
+        }
+        if (n > 0) offset += ((size_t)n < rem) ? (size_t)n : rem - 1;
+    }
+
+truncated:
+    out[offset] = '\0';
+}
+
+#undef DREAM_FORMAT_AS
+
+// Async-signal-safe rendering for the crash handler, which cannot call
+// snprintf: flags, width and precision are ignored and floating point is
+// printed as fixed with six decimals (or d.dddddde+NN when large).
+
+typedef struct DreamFmtOut {
+    char *out;
+    size_t size;
+    size_t offset;
+} DreamFmtOut;
+
+static void dream_fmt_put(DreamFmtOut *o, const char *s, size_t n) {
+    for (size_t i = 0; i < n && o->offset + 1 < o->size; ++i)
+        o->out[o->offset++] = s[i];
+}
+
+static void
+dream_fmt_put_uint(DreamFmtOut *o, uint64_t v, unsigned base, bool upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char buf[24];
+    size_t n = sizeof(buf);
+    do {
+        buf[--n] = digits[v % base];
+        v /= base;
+    } while (v);
+    dream_fmt_put(o, buf + n, sizeof(buf) - n);
+}
+
+static void dream_fmt_put_double(DreamFmtOut *o, double v) {
+    if (v != v) {
+        dream_fmt_put(o, "nan", 3);
+        return;
+    }
+    if (v < 0) {
+        dream_fmt_put(o, "-", 1);
+        v = -v;
+    }
+    if (v - v != 0) {
+        dream_fmt_put(o, "inf", 3);
+        return;
+    }
+    int exponent = 0;
+    if (v >= 1e18) {
+        while (v >= 10) {
+            v /= 10;
+            ++exponent;
+        }
+    }
+    uint64_t whole    = (uint64_t)v;
+    uint64_t fraction = (uint64_t)((v - (double)whole) * 1e6 + 0.5);
+    if (fraction >= 1000000) {
+        ++whole;
+        fraction -= 1000000;
+    }
+    dream_fmt_put_uint(o, whole, 10, false);
+    char buf[7] = ".000000";
+    for (int i = 6; i > 0; --i, fraction /= 10) buf[i] = '0' + fraction % 10;
+    dream_fmt_put(o, buf, sizeof(buf));
+    if (exponent) {
+        dream_fmt_put(o, "e+", 2);
+        dream_fmt_put_uint(o, (uint64_t)exponent, 10, false);
+    }
+}
+
+#define DREAM_READ_AS(type, to_signed, to_unsigned)                            \
+    do {                                                                       \
+        type v;                                                                \
+        if (used + sizeof(v) > args_size) goto truncated;                      \
+        memcpy(&v, args + used, sizeof(v));                                    \
+        used += sizeof(v);                                                     \
+        sv = (to_signed)v;                                                     \
+        uv = (to_unsigned)v;                                                   \
+    } while (0)
+
+size_t _dream_log_format_packed_raw(
+    const char *fmt,
+    const char *args,
+    size_t args_size,
+    char *out,
+    size_t out_size
+) {
+    DreamFmtOut o = {.out = out, .size = out_size};
+    size_t used   = 0;
+
+    for (const char *p = fmt; *p && o.offset + 1 < out_size; ++p) {
+        if (*p != '%') {
+            out[o.offset++] = *p;
+            continue;
+        }
+
+        DreamFmtSpec spec = dream_fmt_parse_spec(p);
+        char conversion   = p[spec.length - 1];
+        p += spec.length - 1;
+        if (used + spec.star_count * sizeof(int) > args_size) break;
+        used += spec.star_count * sizeof(int);
+
+        int64_t sv  = 0;
+        uint64_t uv = 0;
+        switch (spec.kind) {
+            case DREAM_FMT_ARG_NONE: dream_fmt_put(&o, "%", 1); continue;
+            case DREAM_FMT_ARG_INT:
+                DREAM_READ_AS(int, int64_t, unsigned int);
+                break;
+            case DREAM_FMT_ARG_LONG:
+                DREAM_READ_AS(long, int64_t, unsigned long);
+                break;
+            case DREAM_FMT_ARG_LLONG:
+                DREAM_READ_AS(long long, int64_t, unsigned long long);
+                break;
+            case DREAM_FMT_ARG_INTMAX:
+                DREAM_READ_AS(intmax_t, int64_t, uintmax_t);
+                break;
+            case DREAM_FMT_ARG_SIZE:
+                DREAM_READ_AS(size_t, int64_t, size_t);
+                break;
+            case DREAM_FMT_ARG_PTRDIFF:
+                DREAM_READ_AS(ptrdiff_t, int64_t, uint64_t);
+                break;
+            case DREAM_FMT_ARG_POINTER: {
+                DREAM_READ_AS(void *, intptr_t, uintptr_t);
+                dream_fmt_put(&o, "0x", 2);
+                dream_fmt_put_uint(&o, uv, 16, false);
+                continue;
+            }
+            case DREAM_FMT_ARG_DOUBLE: {
+                double v;
+                if (used + sizeof(v) > args_size) goto truncated;
+                memcpy(&v, args + used, sizeof(v));
+                used += sizeof(v);
+                dream_fmt_put_double(&o, v);
+                continue;
+            }
+            case DREAM_FMT_ARG_LDOUBLE: {
+                long double v;
+                if (used + sizeof(v) > args_size) goto truncated;
+                memcpy(&v, args + used, sizeof(v));
+                used += sizeof(v);
+                dream_fmt_put_double(&o, (double)v);
+                continue;
+            }
+            case DREAM_FMT_ARG_STRING: {
+                if (used >= args_size) goto truncated;
+                size_t n = strnlen(args + used, args_size - used);
+                dream_fmt_put(&o, args + used, n);
+                used += n + 1;
+                continue;
+            }
+            case DREAM_FMT_ARG_UNSUPPORTED: continue;
+        }
+
+        switch (conversion) {
+            case 'c': {
+                char c = (char)uv;
+                dream_fmt_put(&o, &c, 1);
+                break;
+            }
+            case 'd':
+            case 'i':
+                if (sv < 0) dream_fmt_put(&o, "-", 1);
+                dream_fmt_put_uint(
+                    &o, sv < 0 ? -(uint64_t)sv : (uint64_t)sv, 10, false
+                );
+                break;
+            case 'o': dream_fmt_put_uint(&o, uv, 8, false); break;
+            case 'x': dream_fmt_put_uint(&o, uv, 16, false); break;
+            case 'X': dream_fmt_put_uint(&o, uv, 16, true); break;
+            default:  dream_fmt_put_uint(&o, uv, 10, false); break;
+        }
+    }
+
+truncated:
+    out[o.offset] = '\0';
+    return o.offset;
+}
+
+#undef DREAM_READ_AS
+
+long _dream_log_flight_read(
+    const void *ring, size_t size, DreamLogFlightLineFn fn, void *user
+) {
+    DreamLogFlightHeader *header = (DreamLogFlightHeader *)ring;
+    if (size < sizeof(*header) ||
+        memcmp(header->magic, DREAM_LOG_FLIGHT_MAGIC, sizeof(header->magic)) ||
+        header->version != DREAM_LOG_FLIGHT_VERSION ||
+        header->header_size < sizeof(*header) || header->slot_count == 0 ||
+        header->slot_size <= sizeof(DreamLogFlightSlot) ||
+        header->header_size > size ||
+        (size - header->header_size) / header->slot_size < header->slot_count)
+        return -1;
+
+    size_t text_cap = header->slot_size - sizeof(DreamLogFlightSlot);
+    char *text      = malloc(text_cap + 1);
+    if (!text) return -1;
+
+    uint64_t next  = atomic_load_explicit(&header->next, memory_order_acquire);
+    uint64_t first = next > header->slot_count ? next - header->slot_count : 0;
+    long lines     = 0;
+    for (uint64_t seq = first; seq < next; ++seq) {
+        DreamLogFlightSlot *slot = _dream_log_flight_slot(header, seq);
+        uint64_t done            = 2 * seq + 2;
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != done)
+            continue; // never finished, or already overwritten
+        size_t len = slot->len < text_cap ? slot->len : text_cap;
+        memcpy(text, slot->text, len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != done)
+            continue; // overwritten while copying
+        text[len] = '\0';
+        fn(text, len, user);
+        ++lines;
+    }
+    free(text);
+    return lines;
+}
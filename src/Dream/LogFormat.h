@@ -0,0 +1,223 @@
+#ifndef DREAM_INTERNAL_LOG_FORMAT
+#define DREAM_INTERNAL_LOG_FORMAT
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed printf arguments, shared by the logger and dream-logcat.
+
+#define DREAM_LOG_PACK_FAILED SIZE_MAX
+
+// Copies the arguments of `fmt` into `out` in their natural width. Returns
+// the bytes written, or DREAM_LOG_PACK_FAILED when the format cannot be
+// deferred and has to be formatted eagerly.
+size_t
+_dream_log_pack_args(const char *fmt, va_list args, char *out, size_t cap);
+
+// Formats `fmt` with arguments packed by _dream_log_pack_args. Stops at
+// the end of `args` if it is shorter than the format expects.
+void _dream_log_format_packed(
+    const char *fmt,
+    const char *args,
+    size_t args_size,
+    char *out,
+    size_t out_size
+);
+
+// Like _dream_log_format_packed, but async-signal-safe (no snprintf):
+// flags, width and precision are ignored. Returns the length of `out`.
+size_t _dream_log_format_packed_raw(
+    const char *fmt,
+    const char *args,
+    size_t args_size,
+    char *out,
+    size_t out_size
+);
+
+// Binary log files (DREAM_LOG_SINK_BINARY).
+//
+// A DreamLogBinaryHeader, then a stream of entries that each start with a
+// tag byte. Integers are unsigned LEB128 varints unless noted.
+//   FORMAT    id, length, format string
+//   CATEGORY  id, length, category name
+//   RECORD    level (u8), category id, format id, zigzag delta of the wall
+//             clock in ns against the previous record (the first one is
+//             against 0), thread id, payload length, payload
+// Formats and categories are defined before the first record using them.
+// Format id 0 means the payload is the formatted text; otherwise it holds
+// the packed arguments, which only decode with the type sizes recorded in
+// the header.
+
+#define DREAM_LOG_BINARY_MAGIC "DRMLOGB"
+#define DREAM_LOG_BINARY_VERSION 1
+#define DREAM_LOG_BINARY_MAX_VARINT 10
+
+typedef enum DreamLogBinaryTag {
+    DREAM_LOG_BINARY_FORMAT   = 1,
+    DREAM_LOG_BINARY_CATEGORY = 2,
+    DREAM_LOG_BINARY_RECORD   = 3,
+} DreamLogBinaryTag;
+
+typedef struct DreamLogBinaryHeader {
+    char magic[8];
+    uint8_t version;
+    uint8_t little_endian;
+    uint8_t sizeof_long;
+    uint8_t sizeof_long_double;
+    uint8_t sizeof_pointer;
+    uint8_t sizeof_size;
+    uint8_t sizeof_intmax;
+    uint8_t sizeof_ptrdiff;
+} DreamLogBinaryHeader;
+
+static inline DreamLogBinaryHeader _dream_log_binary_header(void) {
+    const uint16_t one = 1;
+    return (DreamLogBinaryHeader){
+        .magic              = DREAM_LOG_BINARY_MAGIC,
+        .version            = DREAM_LOG_BINARY_VERSION,
+        .little_endian      = *(const uint8_t *)&one,
+        .sizeof_long        = sizeof(long),
+        .sizeof_long_double = sizeof(long double),
+        .sizeof_pointer     = sizeof(void *),
+        .sizeof_size        = sizeof(size_t),
+        .sizeof_intmax      = sizeof(intmax_t),
+        .sizeof_ptrdiff     = sizeof(ptrdiff_t),
+    };
+}
+
+static inline size_t _dream_log_put_varint(uint8_t *out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns the bytes consumed, 0 if the varint is truncated or too long.
+static inline size_t
+_dream_log_get_varint(const uint8_t *in, size_t size, uint64_t *v) {
+    *v = 0;
+    for (size_t n = 0; n < size && n < DREAM_LOG_BINARY_MAX_VARINT; ++n) {
+        *v |= (uint64_t)(in[n] & 0x7f) << (7 * n);
+        if (!(in[n] & 0x80)) return n + 1;
+    }
+    return 0;
+}
+
+static inline uint64_t _dream_log_zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t _dream_log_unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Flight recorder rings (DREAM_LOG_SINK_RING_BUFFER).
+//
+// A DreamLogFlightHeader, then slot_count slots of slot_size bytes starting
+// at header_size. Writers claim a sequence number from `next` and write
+// line `seq` into slot seq % slot_count. The slot's `seq` word is
+// 2 * seq + 1 while the line is being copied in and 2 * seq + 2 once it is
+// complete, so a reader, even one looking at the file after the process
+// died, can tell finished lines from torn or overwritten ones.
+
+#define DREAM_LOG_FLIGHT_MAGIC "DRMFLTR"
+#define DREAM_LOG_FLIGHT_VERSION 1
+#define DREAM_LOG_FLIGHT_HEADER_SIZE 64
+
+typedef struct DreamLogFlightHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t pid;
+    uint32_t reserved;
+    _Atomic uint64_t next; // sequence number of the next line
+} DreamLogFlightHeader;
+
+typedef struct DreamLogFlightSlot {
+    _Atomic uint64_t seq;
+    uint32_t len;
+    uint32_t reserved;
+    char text[];
+} DreamLogFlightSlot;
+
+typedef void (*DreamLogFlightLineFn)(const char *text, size_t len, void *user);
+
+static inline DreamLogFlightSlot *
+_dream_log_flight_slot(DreamLogFlightHeader *header, uint64_t seq) {
+    return (DreamLogFlightSlot *)((char *)header + header->header_size +
+                                  (seq % header->slot_count) *
+                                      header->slot_size);
+}
+
+// Calls `fn` with every complete line still in the ring, oldest first; the
+// text is also NUL terminated.
+// `size` is the number of bytes readable at `ring`. Returns the number of
+// lines passed to `fn`, or -1 if `ring` is not a flight recorder ring.
+long _dream_log_flight_read(
+    const void *ring, size_t size, DreamLogFlightLineFn fn, void *user
+);
+
+// Shared-memory transport (DREAM_LOG_SINK_SHM).
+//
+// One POSIX shared-memory object per process: a DreamLogShmHeader, then
+// `capacity` bytes of records (a power of two) used as a ring with a
+// single writer, the logging process, and a single reader, dream-logcollect.
+// `tail` and `head` count bytes from the start and only grow. The writer
+// publishes a record by moving tail past it, the reader frees it by moving
+// head. Records are 8-byte aligned and never wrap: one that would is
+// preceded by a PAD record filling the rest of the ring. A writer that
+// finds no room drops the record and counts it in `dropped`; it never waits
+// for the reader.
+
+#define DREAM_LOG_SHM_MAGIC "DRMSHMR"
+#define DREAM_LOG_SHM_VERSION 1
+#define DREAM_LOG_SHM_HEADER_SIZE 192
+#define DREAM_LOG_SHM_PREFIX "dream-log." // default name: /dream-log.<pid>
+
+typedef enum DreamLogShmKind {
+    DREAM_LOG_SHM_RECORD = 1,
+    DREAM_LOG_SHM_PAD    = 2,
+} DreamLogShmKind;
+
+typedef struct DreamLogShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t capacity;
+    uint32_t pid;
+    _Atomic uint32_t closed; // the writer has shut down
+    uint8_t reserved0[32];
+    // Writer and reader positions on cache lines of their own.
+    _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    uint8_t reserved1[48];
+    _Atomic uint64_t head;
+    uint8_t reserved2[56];
+} DreamLogShmHeader;
+
+typedef struct DreamLogShmRecord {
+    uint32_t size; // whole record, padding included
+    uint8_t kind;  // DreamLogShmKind, PAD records only have size and kind
+    uint8_t level;
+    uint8_t category_len;
+    uint8_t reserved;
+    uint32_t threadid;
+    uint32_t message_len;
+    uint64_t wall_ns;
+    char text[]; // category, then message, neither NUL terminated
+} DreamLogShmRecord;
+
+static inline DreamLogShmRecord *
+_dream_log_shm_record(DreamLogShmHeader *header, uint64_t pos) {
+    return (DreamLogShmRecord *)((char *)header + header->header_size +
+                                 (pos & (header->capacity - 1)));
+}
+
+#endif // !DREAM_INTERNAL_LOG_FORMAT
@@ -1,3 +1,5 @@
+#include <assert.h>
+#include <stdalign.h>
 #include <stdatomic.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -5,6 +7,8 @@
 #include <threads.h>
 #ifndef REMOVE_DREAM_LOGGER
 
+#include "Allocator.h"
+#include "LogFormat.h"
 #include "Logger.h"
 
 #include <stdarg.h>
@@ -19,35 +23,328 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
+#if defined(DREAM_PLATFORM_LINUX)
+#include <linux/futex.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define DREAM_HAS_TSC
+#endif
+
 #define DREAM_LOG_MAX_MESSAGE 1024
+#define DREAM_LOG_MAX_LINE 1400
+#define DREAM_LOG_MIN_SEGMENT (64u * 1024u)
 typedef struct DreamLogMsg {
     DreamLogLevel level;
-    uint32_t timestamp;
+    uint64_t timestamp; // clock ticks, see dream_log_now
     uint32_t threadid;
     uint32_t pid;
-    char category[32];
+    DreamLogCategoryId category_id;
+    const char *category; // interned name, lives as long as the process
+    const char *fmt;      // non-null: args holds packed args for fmt
+    const char *args;     // on the producer side this is message
+    uint32_t args_size;   // bytes of packed args
+    bool has_text;        // message holds the formatted text
     char message[DREAM_LOG_MAX_MESSAGE];
+    // Set by dream_dispatch: the line rendered once and shared by all sinks.
+    // Colored outputs wrap the same line in escape codes.
+    const char *line;
+    size_t line_len;
 } DreamLogMsg;
 
+// The async queue is a byte ring carved into cache-line sized cells. Each
+// record is a DreamLogRecord header followed by its payload (message text or
+// packed args) and takes only as many cells as it needs; the payload may wrap
+// around the end of the ring. head/tail count cells.
+//
+// Every cell carries a sequence number (Vyukov's bounded queue, generalised to
+// records spanning several cells). For the cell at position pos:
+//   seq == pos            free, a producer may claim it
+//   seq == pos + 1        a complete record header was published at pos
+//   seq == pos + capacity consumed and released for the next lap
+// Producers claim cells by CAS on tail after checking they are all free, then
+// publish the header. Consumers claim a published record by CAS on head before
+// touching it, so a record is never read half-written or consumed twice, and a
+// DROP_OLDEST producer discards records the same way the worker consumes them.
+#define DREAM_LOG_CELL_SIZE 64
+#define DREAM_LOG_AVG_RECORD_CELLS 2
+#define DREAM_LOG_MIN_QUEUE_CELLS 64
+
+typedef struct DreamLogRecord {
+    _Atomic uint32_t cells; // cells taken by header + payload
+    uint16_t payload_size;
+    uint8_t level;
+    _Atomic uint64_t timestamp; // peeked by the timestamp-ordered drain
+    const char *fmt;            // non-null: payload holds packed args for fmt
+    uint32_t threadid;
+    uint32_t pid;
+    DreamLogCategoryId category;
+} DreamLogRecord;
+
+static_assert(
+    DREAM_LOG_TRACE == DREAM_LOG_LEVEL_TRACE &&
+        DREAM_LOG_INFO == DREAM_LOG_LEVEL_INFO &&
+        DREAM_LOG_DEBUG == DREAM_LOG_LEVEL_DEBUG &&
+        DREAM_LOG_WARNING == DREAM_LOG_LEVEL_WARNING &&
+        DREAM_LOG_CRITICAL == DREAM_LOG_LEVEL_CRITICAL &&
+        DREAM_LOG_FATAL == DREAM_LOG_LEVEL_FATAL &&
+        DREAM_LOG_OFF == DREAM_LOG_LEVEL_OFF,
+    "compile-time level numbers must match DreamLogLevel"
+);
+static_assert(
+    sizeof(DreamLogRecord) <= DREAM_LOG_CELL_SIZE,
+    "record header must fit a single cell"
+);
+static_assert(
+    DREAM_LOG_MIN_QUEUE_CELLS * DREAM_LOG_CELL_SIZE >=
+        2 * (DREAM_LOG_CELL_SIZE + DREAM_LOG_MAX_MESSAGE),
+    "queue must hold at least two maximum sized records"
+);
+
 typedef struct DLMRingBuffer {
-    DreamLogMsg *buffer;
-    _Atomic size_t head;
-    _Atomic size_t tail;
+    uint8_t *buffer;
+    _Atomic size_t *seq; // one per cell
+    size_t cell_count;   // power of two
+    alignas(DREAM_LOG_CELL_SIZE) _Atomic size_t head;
+    _Atomic size_t high_water; // cells, sampled by the worker
+    alignas(DREAM_LOG_CELL_SIZE) _Atomic size_t tail;
+    // Producer counters share the tail's cache line, which a producer owns
+    // anyway right after claiming cells.
+    _Atomic uint64_t enqueued;
+    _Atomic uint64_t dropped_newest;
+    _Atomic uint64_t dropped_oldest;
+    _Atomic uint64_t blocked;
+    _Atomic uint64_t blocked_ns;
 } DLMRingBuffer;
 
+// Opt-in per-thread queues: each logging thread lazily gets a private ring so
+// producers never share a tail. Queues are only freed at shutdown; when their
+// thread exits they are retired and handed to the next thread that asks.
+#define DREAM_LOG_DEFAULT_THREAD_QUEUE_BYTES (64 * 1024)
+#define DREAM_LOG_DRAIN_BATCH 64
+
+// Worker wakeup. Producers never signal a running worker. Once it runs dry the
+// worker spins for a while, then parks: "timed" right after it had work, so
+// that a steady trickle of records is picked up in batches at the latency
+// deadline without any producer syscall, or "idle" when the last timed park
+// found nothing, in which case the next record rings the doorbell. Producers
+// also ring it when their queue crosses the fill threshold or overflows.
+#define DREAM_LOG_DEFAULT_SPIN_COUNT 1000
+#define DREAM_LOG_DEFAULT_WAKE_FILL_PERCENT 50
+#define DREAM_LOG_DEFAULT_WAKE_LATENCY_US 1000
+
+typedef enum DreamLogWorkerState {
+    DREAM_LOG_WORKER_RUNNING,
+    DREAM_LOG_WORKER_PARKED_TIMED,
+    DREAM_LOG_WORKER_PARKED_IDLE,
+} DreamLogWorkerState;
+
+// Buffered sink output. In async mode the worker is the only writer, so the
+// stdout/stderr/file sinks append to a per-descriptor buffer that goes out in
+// a single write() when the batch held a record at or above the flush level,
+// when the flush interval has passed, when the buffer fills up, or before the
+// worker parks. Synchronous logging writes each line straight through.
+#define DREAM_LOG_DEFAULT_SINK_BUFFER_BYTES (64 * 1024)
+#define DREAM_LOG_DEFAULT_URING_BUFFERS 4
+#define DREAM_LOG_DEFAULT_FLUSH_LEVEL DREAM_LOG_WARNING
+#define DREAM_LOG_DEFAULT_FLUSH_INTERVAL_MS 50
+
+typedef enum DreamLogOutput {
+    DREAM_LOG_OUT_STDOUT,
+    DREAM_LOG_OUT_STDERR,
+    DREAM_LOG_OUT_FILE,
+    DREAM_LOG_OUT_BINARY,
+    DREAM_LOG_OUT_COUNT,
+} DreamLogOutput;
+
+typedef struct DreamLogWriteBuffer {
+    int fd; // -1: unused
+    char *data;
+    size_t used;
+    size_t capacity;
+    bool isolated;      // owned by an isolated sink's thread, not the worker
+    bool flush_pending; // isolated only, the worker uses g_logger's
+} DreamLogWriteBuffer;
+
+// Dictionary state of the binary sink, see LogFormat.h. Format strings are
+// keyed by address, which is why the sink needs deferred formatting to
+// save anything: eagerly formatted records carry their text.
+typedef struct DreamLogBinaryState {
+    const char **formats; // open addressing, load factor <= 1/2
+    uint32_t *format_ids;
+    uint32_t format_capacity;
+    uint32_t format_count;
+    uint64_t categories_defined[DREAM_LOG_MAX_CATEGORIES / 64];
+    uint64_t last_wall_ns;
+    mtx_t lock; // sync mode: entries must reach the file in encoding order
+} DreamLogBinaryState;
+
+// Memory-mapped file output (logfile_segment_bytes). Lines are copied
+// into a preallocated MAP_SHARED segment, so they reach the page cache
+// without a syscall and survive the process dying; the sync policy only
+// decides when they are forced to disk.
+typedef struct DreamLogMappedFile {
+    char *path; // nullptr: the file sink uses write()
+    int fd;
+    char *map;
+    size_t size;
+    size_t used;
+    size_t synced; // prefix already forced out with msync
+    uint64_t opened_ns;
+    uint64_t max_age_ns; // 0: no limit
+    uint32_t keep;
+    DreamLogFileSync sync;
+    DreamLogLevel sync_level;
+    uint64_t sync_interval_ns;
+    uint64_t last_sync_ns;
+    mtx_t lock; // sync mode: callers share the segment
+} DreamLogMappedFile;
+
+// Shared-memory output (DREAM_LOG_SINK_SHM), laid out as described in
+// LogFormat.h. The collector does the file I/O and the line formatting.
+#define DREAM_LOG_DEFAULT_SHM_BYTES (1024 * 1024)
+#define DREAM_LOG_MIN_SHM_BYTES (64 * 1024)
+#define DREAM_LOG_SHM_NAME_TRIES 16 // name, then name.1 to name.15
+
+typedef struct DreamLogShm {
+    DreamLogShmHeader *header; // nullptr: not in use
+    size_t size;
+    char name[NAME_MAX];
+    mtx_t lock; // sync mode: callers share the ring
+} DreamLogShm;
+
+#if defined(DREAM_PLATFORM_LINUX)
+typedef struct DreamLogUringBuffer {
+    char *data;
+    size_t len;
+    uint64_t offset;
+    bool busy;
+} DreamLogUringBuffer;
+
+// io_uring file output (async_file_uring). The worker fills one of a few
+// registered buffers and submits it as a write at an explicit offset, so
+// writes may complete in any order; it only waits for the disk when every
+// buffer is still in flight.
+typedef struct DreamLogUring {
+    int fd; // -1: not in use
+    int file_fd;
+    _Atomic uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    struct io_uring_sqe *sqes;
+    _Atomic uint32_t *cq_head;
+    _Atomic uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring; // same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    bool fixed; // buffers registered, writes use IORING_OP_WRITE_FIXED
+    DreamLogUringBuffer *buffers;
+    uint32_t buffer_slots; // allocated, buffer_count of them have data
+    uint32_t buffer_count;
+    size_t buffer_capacity;
+    uint32_t current;
+    uint64_t offset; // where the next submitted buffer goes
+} DreamLogUring;
+#endif
+
+typedef struct DreamLogThreadQueue {
+    DLMRingBuffer ring;
+    struct DreamLogThreadQueue *next;
+    atomic_bool in_use;
+} DreamLogThreadQueue;
+
+// Isolated sinks (DreamLoggerSink.isolated). Claiming a record frees its
+// cells, so the shared queues cannot serve a cursor per sink; instead the
+// worker copies each record an isolated sink wants into that sink's backlog,
+// a queue of the same kind with the worker as its only producer, and the
+// sink's own thread writes it from there. A full backlog drops the record
+// rather than making the worker wait.
+#define DREAM_LOG_DEFAULT_SINK_BACKLOG_BYTES (256 * 1024)
+
+typedef struct DreamLogSinkWorker {
+    DLMRingBuffer backlog;
+    DreamLoggerSink *sink;
+    DreamLogWriteBuffer *out; // output the thread owns, if any
+    uint64_t last_flush_ns;
+    thrd_t thread;
+    atomic_bool running;
+    _Atomic uint32_t state; // DreamLogWorkerState, doubles as futex word
+    _Atomic uint64_t written;
+} DreamLogSinkWorker;
+
+// Profiling zones (profile_path). A zone is recorded when it ends, as one
+// event in a buffer owned by its thread: a single-producer ring that the
+// profiler thread empties into Chrome trace JSON every flush interval.
+// Names are recorded by address, so formatting them is left to the
+// profiler thread too. Buffers are only freed at shutdown; a buffer whose
+// thread exited is handed to the next thread that records a zone.
+#define DREAM_PROFILE_DEFAULT_THREAD_BYTES (256 * 1024)
+#define DREAM_PROFILE_DEFAULT_FLUSH_MS 20
+#define DREAM_PROFILE_WRITE_BYTES (64 * 1024)
+
+typedef struct DreamProfileEvent {
+    const char *name;
+    uint64_t start; // clock ticks, see dream_profile_now
+    uint64_t end;
+    uint32_t threadid;
+} DreamProfileEvent;
+
+typedef struct DreamProfileThread {
+    DreamProfileEvent *events;
+    size_t capacity; // power of two
+    struct DreamProfileThread *next;
+    atomic_bool in_use;
+    alignas(DREAM_LOG_CELL_SIZE) _Atomic uint64_t head; // profiler thread
+    alignas(DREAM_LOG_CELL_SIZE) _Atomic uint64_t tail; // owning thread
+    uint64_t head_seen; // owner's copy of head, reloaded when it looks full
+    uint32_t threadid;
+    _Atomic uint64_t dropped;
+} DreamProfileThread;
+
+typedef struct DreamProfiler {
+    int fd; // -1: not profiling
+    size_t thread_capacity;
+    uint64_t flush_interval_ns;
+    uint64_t start_wall_ns;
+    _Atomic(DreamProfileThread *) threads;
+    tss_t thread_key;
+    thrd_t thread;
+    atomic_bool running;
+    _Atomic uint32_t wake; // futex word, bumped to stop the thread early
+    char *out;             // JSON not written yet
+    size_t used;
+    bool any_events;
+} DreamProfiler;
+
+// Flight recorder, laid out as described in LogFormat.h so the same bytes
+// can be read back from a file after a crash. Writers only touch shared
+// memory: a fetch_add to claim a slot and a copy into it.
 typedef struct DreamRingBuffer {
     bool initialized;
     bool dump_after_async_thread_join;
-    char *buffer;      /* contiguous memory */
-    uint32_t capacity; /* number of lines */
-    uint32_t line_len; /* max chars per line */
-    uint32_t head;     /* next write index */
-    uint32_t count;    /* valid lines */
+    DreamLogFlightHeader *header;
+    size_t size;
+    bool mapped; // ring_buffer_path: a MAP_SHARED file, else calloc'd
 } DreamRingBuffer;
 
 typedef struct DreamLoggerState {
@@ -60,20 +357,62 @@ typedef struct DreamLoggerState {
     DreamLogLevel global_min_log_level;
     DreamLoggerSink **sinks;
     uint16_t sink_count;
-    FILE *logfile;
+    int logfile_fd;
+    DreamLogWriteBuffer out[DREAM_LOG_OUT_COUNT];
+    DreamLogBinaryState binary;
+    DreamLogMappedFile mapped;
+    DreamLogShm shm;
+    DreamProfiler profile;
+#if defined(DREAM_PLATFORM_LINUX)
+    DreamLogUring uring;
+#endif
+    DreamLogLevel flush_level;
+    uint64_t flush_interval_ns;
+    uint64_t last_flush_ns;
+    bool flush_pending;
+
+    DreamLogClock clock;
+    uint64_t clock_base_ticks;
+    uint64_t clock_base_mono_ns;
+    uint64_t clock_base_wall_ns;
+    uint64_t tsc_ns_mult; // ns per tick, 32.32 fixed point
     DreamRingBuffer ring;
     DreamLogCallbackFn callback;
     void *callback_user_data;
 
+    uint64_t rate_interval_ns; // 0: no rate limit
+    uint64_t rate_burst_ns;    // how far a site's rate_tat may run ahead
+    bool collapse_repeats;
+    uint64_t collapse_window_ns;
+    uint64_t last_site_sweep_ns;
+    int64_t utc_offset_s; // local time for the crash handler, taken at init
+    uint32_t pid;
+
     bool async_enabled;
+    bool async_deferred_format;
     DLMRingBuffer async_ringbuff;
-    size_t async_queue_capacity; // no of DreamLogMsg elements
+    bool async_per_thread_queues;
+    size_t async_thread_queue_bytes;
+    _Atomic(DreamLogThreadQueue *) thread_queues;
+    tss_t thread_queue_key;
+    uint32_t generation; // bumped per init, invalidates cached thread queues
     DreamLogAsyncOverflowPolicy async_log_overflow_policy;
 
     thrd_t async_worker;
     atomic_bool async_thread_running;
+    _Atomic uint32_t worker_state; // DreamLogWorkerState, doubles as futex word
+    uint32_t async_spin_count;
+    uint32_t async_wake_fill_percent;
+    uint64_t async_wake_latency_ns;
+    DreamLogDrainOrder async_drain_order;
+    // Only the worker writes these, so plain loads and stores suffice.
+    _Atomic uint64_t stats_written;
+    _Atomic uint64_t stats_latency_max_ns;
+    _Atomic uint64_t stats_latency[DREAM_LOG_LATENCY_BUCKETS];
+#if !defined(DREAM_PLATFORM_LINUX)
     mtx_t sleep_mutex;
     cnd_t sleep_cond;
+#endif
 
 #ifdef DREAM_PLATFORM_WIN32
     HANDLE console;
@@ -83,6 +422,84 @@ typedef struct DreamLoggerState {
 
 static DreamLoggerState g_logger;
 
+static thread_local DreamLogThreadQueue *t_thread_queue;
+static thread_local uint32_t t_thread_queue_generation;
+static thread_local DreamProfileThread *t_profile_thread;
+static thread_local uint32_t t_profile_thread_generation;
+// Checked by DreamZoneBegin/End before anything else.
+static atomic_bool g_dream_profile_on;
+// DreamZoneEnd calls in progress, counted in slots on separate cache lines
+// so that threads ending zones do not contend on one counter. Shutdown
+// clears g_dream_profile_on and waits for every slot to drain before it
+// frees the buffers.
+#define DREAM_PROFILE_WRITER_SLOTS 64
+typedef struct DreamProfileWriters {
+    alignas(DREAM_LOG_CELL_SIZE) _Atomic uint32_t count;
+} DreamProfileWriters;
+static DreamProfileWriters g_dream_profile_writers[DREAM_PROFILE_WRITER_SLOTS];
+static _Atomic uint32_t g_dream_profile_next_slot;
+static thread_local uint32_t t_profile_slot; // slot + 1, 0: none yet
+
+// Category names are interned into a table that is never reset, so ids
+// cached at call sites survive a DreamLoggerShutdown/Init cycle. Lookups
+// probe an open-addressed hash of ids without locking; inserts take the
+// lock. Id 0 is never hashed: it collects every category once the table is
+// full.
+#define DREAM_LOG_CATEGORY_NAME_LEN 32
+#define DREAM_LOG_CATEGORY_SLOTS (2 * DREAM_LOG_MAX_CATEGORIES)
+
+typedef struct DreamLogCategoryTable {
+    char names[DREAM_LOG_MAX_CATEGORIES][DREAM_LOG_CATEGORY_NAME_LEN];
+    _Atomic DreamLogCategoryId slots[DREAM_LOG_CATEGORY_SLOTS]; // 0: empty
+    uint32_t count;
+    mtx_t lock;
+} DreamLogCategoryTable;
+
+static DreamLogCategoryTable g_log_categories = {
+    .names = {"other"},
+    .count = 1,
+};
+static once_flag g_log_categories_once = ONCE_FLAG_INIT;
+
+_Atomic uint8_t g_dream_log_category_levels[DREAM_LOG_MAX_CATEGORIES];
+
+static void dream_log_categories_init(void) {
+    mtx_init(&g_log_categories.lock, mtx_plain);
+}
+
+// FNV-1a over the part of the name that is kept.
+static uint32_t dream_log_category_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < DREAM_LOG_CATEGORY_NAME_LEN - 1 && name[i]; ++i) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns 0 when name has not been interned yet.
+static DreamLogCategoryId
+dream_log_category_find(const char *name, uint32_t hash) {
+    for (uint32_t i = 0; i < DREAM_LOG_CATEGORY_SLOTS; ++i) {
+        DreamLogCategoryId id = atomic_load_explicit(
+            &g_log_categories.slots[(hash + i) % DREAM_LOG_CATEGORY_SLOTS],
+            memory_order_acquire
+        );
+        if (!id) return 0;
+        if (strncmp(
+                g_log_categories.names[id],
+                name,
+                DREAM_LOG_CATEGORY_NAME_LEN - 1
+            ) == 0)
+            return id;
+    }
+    return 0;
+}
+
+static const char *dream_log_category_name(DreamLogCategoryId id) {
+    return g_log_categories.names[id];
+}
+
 static const char *dream_log_level_string(DreamLogLevel level) {
     switch (level) {
         case DREAM_LOG_TRACE:    return "TRACE";
@@ -152,308 +569,2654 @@ static const char *dream_log_level_color_ansi(DreamLogLevel level) {
     }
 }
 
-static void dream_set_color(DreamLogLevel level) {
-    if (g_logger.use_color) fputs(dream_log_level_color_ansi(level), stdout);
+static uint32_t dream_thread_id(void) {
+    return (uint32_t)(uintptr_t)pthread_self();
 }
 
-static void dream_reset_color(void) {
-    if (g_logger.use_color) fputs("\033[0m", stdout);
+static inline uint64_t dream_clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
 }
 
-static uint32_t dream_thread_id(void) {
-    return (uint32_t)(uintptr_t)pthread_self();
+static uint64_t dream_monotonic_ns(void) {
+    return dream_clock_ns(CLOCK_MONOTONIC);
 }
 
-static void dream_time_string(char *out, size_t size) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
+// Storm suppression only needs millisecond precision.
+static inline uint64_t dream_coarse_ns(void) {
+#if defined(CLOCK_MONOTONIC_COARSE)
+    return dream_clock_ns(CLOCK_MONOTONIC_COARSE);
+#else
+    return dream_monotonic_ns();
+#endif
+}
 
-    struct tm tm;
-    localtime_r(&tv.tv_sec, &tm);
+// Timestamps are taken on the calling thread in raw ticks of the configured
+// clock and only turned into wall time when the line is formatted, which in
+// async mode happens on the worker.
+static inline uint64_t dream_log_now(void) {
+    switch (g_logger.clock) {
+#if defined(DREAM_HAS_TSC)
+        case DREAM_LOG_CLOCK_TSC: return __rdtsc();
+#endif
+#if defined(CLOCK_MONOTONIC_COARSE)
+        case DREAM_LOG_CLOCK_MONOTONIC_COARSE:
+            return dream_clock_ns(CLOCK_MONOTONIC_COARSE);
+#endif
+        default: return dream_clock_ns(CLOCK_MONOTONIC);
+    }
+}
+
+static bool dream_tsc_is_invariant(void) {
+#if defined(DREAM_HAS_TSC)
+    unsigned a, b, c, d;
+    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+#else
+    return false;
+#endif
+}
+
+// Pairs the tick clock with CLOCK_MONOTONIC and CLOCK_REALTIME.
+static void dream_clock_init(DreamLogClock clock) {
+    if (clock == DREAM_LOG_CLOCK_TSC && !dream_tsc_is_invariant())
+        clock = DREAM_LOG_CLOCK_MONOTONIC;
+    g_logger.clock = clock;
+
+    g_logger.clock_base_mono_ns = dream_monotonic_ns();
+    g_logger.clock_base_wall_ns = dream_clock_ns(CLOCK_REALTIME);
+    g_logger.clock_base_ticks   = dream_log_now();
+    g_logger.tsc_ns_mult        = 1ull << 32;
+}
+
+// Measures the TSC rate against CLOCK_MONOTONIC, sleeping 20 ms. Run by
+// DreamLoggerInit before anything converts a timestamp.
+static void dream_tsc_calibrate(void) {
+    if (g_logger.clock != DREAM_LOG_CLOCK_TSC) return;
+
+    thrd_sleep(&(struct timespec){.tv_nsec = 20000000}, nullptr);
+    uint64_t ticks = dream_log_now() - g_logger.clock_base_ticks;
+    uint64_t ns    = dream_monotonic_ns() - g_logger.clock_base_mono_ns;
+    if (ticks)
+        g_logger.tsc_ns_mult =
+            (uint64_t)(((unsigned __int128)ns << 32) / ticks);
+}
+
+static uint64_t dream_log_wall_ns(uint64_t ticks) {
+    uint64_t mono_ns = ticks;
+    if (g_logger.clock == DREAM_LOG_CLOCK_TSC) {
+        unsigned __int128 delta = ticks - g_logger.clock_base_ticks;
+        mono_ns                 = g_logger.clock_base_mono_ns +
+                  (uint64_t)((delta * g_logger.tsc_ns_mult) >> 32);
+    }
+    return g_logger.clock_base_wall_ns +
+           (mono_ns - g_logger.clock_base_mono_ns);
+}
+
+// Renders a timestamp as local "HH:MM:SS.mmm". localtime_r only runs when
+// the second changes; the cache is per thread since sync logging formats on
+// the calling thread.
+static void dream_time_string(uint64_t timestamp, char *out, size_t size) {
+    static thread_local time_t cached_sec = -1;
+    static thread_local char cached_hms[16];
+
+    uint64_t wall = dream_log_wall_ns(timestamp);
+    time_t sec    = (time_t)(wall / 1000000000u);
+    if (sec != cached_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        snprintf(
+            cached_hms,
+            sizeof(cached_hms),
+            "%02d:%02d:%02d",
+            tm.tm_hour,
+            tm.tm_min,
+            tm.tm_sec
+        );
+        cached_sec = sec;
+    }
 
     snprintf(
         out,
         size,
-        "%02d:%02d:%02d.%03ld",
-        tm.tm_hour,
-        tm.tm_min,
-        tm.tm_sec,
-        tv.tv_usec / 1000
+        "%s.%03u",
+        cached_hms,
+        (unsigned)((wall / 1000000u) % 1000u)
     );
 }
 
-static int DreamAsyncWorkerFn(void *args) {
-    for (;;) {
-        size_t head = atomic_load_explicit(
-            &g_logger.async_ringbuff.head, memory_order_acquire
-        );
-        size_t tail = atomic_load_explicit(
-            &g_logger.async_ringbuff.tail, memory_order_acquire
-        );
-        if (head == tail) {
-            // No work available
-            if (!atomic_load_explicit(
-                    &g_logger.async_thread_running, memory_order_acquire
-                ))
-                break;
-
-            // Sleep until signaled
-            mtx_lock(&g_logger.sleep_mutex);
-            head = atomic_load_explicit(
-                &g_logger.async_ringbuff.head, memory_order_acquire
-            );
-            tail = atomic_load_explicit(
-                &g_logger.async_ringbuff.tail, memory_order_acquire
-            );
-            if (head == tail &&
-                atomic_load_explicit(
-                    &g_logger.async_thread_running, memory_order_acquire
-                )) {
-                cnd_wait(&g_logger.sleep_cond, &g_logger.sleep_mutex);
-            }
-            mtx_unlock(&g_logger.sleep_mutex);
+static void dream_fd_write_all(int fd, const char *data, size_t n) {
+    while (n) {
+        ssize_t written = write(fd, data, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        n -= (size_t)written;
+    }
+}
 
+static void dream_fd_writev_all(int fd, struct iovec *iov, int count) {
+    ssize_t written;
+    do {
+        written = writev(fd, iov, count);
+    } while (written < 0 && errno == EINTR);
+    if (written < 0) return;
+
+    // Short write: finish piece by piece.
+    size_t done = (size_t)written;
+    for (int i = 0; i < count; ++i) {
+        if (done >= iov[i].iov_len) {
+            done -= iov[i].iov_len;
             continue;
         }
+        dream_fd_write_all(
+            fd, (const char *)iov[i].iov_base + done, iov[i].iov_len - done
+        );
+        done = 0;
+    }
+}
 
-        DreamLogMsg *event = &g_logger.async_ringbuff
-                                  .buffer[head % g_logger.async_queue_capacity];
+static void dream_mapped_sync(DreamLogMappedFile *m) {
+    if (m->synced < m->used) {
+        size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = m->synced & ~(page - 1);
+        msync(m->map + start, m->used - start, MS_SYNC);
+        m->synced = m->used;
+    }
+    m->last_sync_ns = dream_monotonic_ns();
+}
 
-        for (size_t i = 0; i < g_logger.sink_count; ++i) {
-            DreamLoggerSink *sink = g_logger.sinks[i];
-            if (event->level >= sink->min_level) sink->__write(sink, event);
-        }
+static void dream_mapped_maybe_sync(DreamLogMappedFile *m) {
+    if (m->map && m->sync != DREAM_LOG_FILE_SYNC_NONE &&
+        dream_monotonic_ns() - m->last_sync_ns >= m->sync_interval_ns)
+        dream_mapped_sync(m);
+}
 
-        atomic_fetch_add_explicit(
-            &g_logger.async_ringbuff.head, 1, memory_order_release
-        );
+static bool dream_mapped_open(DreamLogMappedFile *m) {
+    int fd = open(m->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    // Reserve the blocks up front so a full disk shows up here rather than
+    // as SIGBUS on a store into the mapping.
+    if (posix_fallocate(fd, 0, (off_t)m->size) != 0 &&
+        ftruncate(fd, (off_t)m->size) != 0) {
+        close(fd);
+        return false;
     }
+    void *map =
+        mmap(nullptr, m->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    m->fd           = fd;
+    m->map          = map;
+    m->used         = 0;
+    m->synced       = 0;
+    m->opened_ns    = dream_coarse_ns();
+    m->last_sync_ns = dream_monotonic_ns();
+    return true;
+}
 
-    return 0;
+static void dream_mapped_close(DreamLogMappedFile *m) {
+    if (!m->map) return;
+    if (m->sync != DREAM_LOG_FILE_SYNC_NONE) dream_mapped_sync(m);
+    munmap(m->map, m->size);
+    (void)!ftruncate(m->fd, (off_t)m->used); // drop the unused tail
+    if (m->sync != DREAM_LOG_FILE_SYNC_NONE) fdatasync(m->fd);
+    close(m->fd);
+    m->map = nullptr;
+    m->fd  = -1;
 }
 
-static void dream_write_stdout(const char *text) {
-    fputs(text, stdout);
-    fflush(stdout);
+// path -> path.1 -> ... -> path.<keep>; the oldest falls off the end.
+static void dream_mapped_shift(const DreamLogMappedFile *m) {
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+    if (m->keep == 0) {
+        unlink(m->path);
+        return;
+    }
+    for (uint32_t i = m->keep; i > 1; --i) {
+        snprintf(from, sizeof(from), "%s.%u", m->path, i - 1);
+        snprintf(to, sizeof(to), "%s.%u", m->path, i);
+        rename(from, to); // gaps are fine
+    }
+    snprintf(to, sizeof(to), "%s.1", m->path);
+    rename(m->path, to);
 }
 
-static void dream_write_stderr(const char *text) {
-    fputs(text, stderr);
-    fflush(stderr);
+// A segment left by a crash still has its preallocated tail of zeros.
+static void dream_mapped_trim(const char *path) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    char block[4096];
+    off_t end = fstat(fd, &st) == 0 ? st.st_size : 0;
+    while (end > 0) {
+        off_t start = end > (off_t)sizeof(block) ? end - sizeof(block) : 0;
+        ssize_t n   = pread(fd, block, (size_t)(end - start), start);
+        if (n != end - start) break;
+        while (n > 0 && block[n - 1] == '\0') --n;
+        if (n > 0) {
+            end = start + n;
+            break;
+        }
+        end = start;
+    }
+    if (end < st.st_size) (void)!ftruncate(fd, end);
+    close(fd);
 }
 
-static void dream_write_file(const char *text) {
-    if (g_logger.logfile) {
-        fputs(text, g_logger.logfile);
-        fflush(g_logger.logfile);
+static bool dream_mapped_init(const DreamLoggerConfig *config) {
+    DreamLogMappedFile *m = &g_logger.mapped;
+    size_t page           = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size           = config->logfile_segment_bytes;
+    if (size < DREAM_LOG_MIN_SEGMENT) size = DREAM_LOG_MIN_SEGMENT;
+
+    *m = (DreamLogMappedFile){
+        .path = _dream_strdup(DREAM_MEMORY_LOGGER, config->logfile_path),
+        .fd   = -1,
+        .size       = (size + page - 1) & ~(page - 1),
+        .max_age_ns = (uint64_t)config->logfile_max_age_s * 1000000000u,
+        .keep       = config->logfile_keep_count,
+        .sync       = config->logfile_sync,
+        .sync_level = config->logfile_sync_level,
+        .sync_interval_ns =
+            (uint64_t)(config->logfile_sync_interval_ms
+                           ? config->logfile_sync_interval_ms
+                           : 1000) *
+            1000000u,
+    };
+    if (!m->path) return false;
+
+    struct stat st;
+    if (stat(m->path, &st) == 0 && st.st_size > 0) {
+        dream_mapped_trim(m->path);
+        dream_mapped_shift(m);
     }
+    if (!dream_mapped_open(m)) {
+        _dream_free_str(DREAM_MEMORY_LOGGER, m->path);
+        m->path = nullptr;
+        return false;
+    }
+    mtx_init(&m->lock, mtx_plain);
+    return true;
 }
 
-static bool dream_async_push(const DreamLogMsg *log) {
-    size_t tail = atomic_fetch_add_explicit(
-        &g_logger.async_ringbuff.tail, 1, memory_order_acq_rel
-    );
-    size_t head = atomic_load_explicit(
-        &g_logger.async_ringbuff.head, memory_order_acquire
-    );
+static void dream_mapped_shutdown(void) {
+    DreamLogMappedFile *m = &g_logger.mapped;
+    if (!m->path) return;
+    dream_mapped_close(m);
+    mtx_destroy(&m->lock);
+    _dream_free_str(DREAM_MEMORY_LOGGER, m->path);
+    m->path = nullptr;
+}
 
-    if ((tail - head) >= g_logger.async_queue_capacity) {
-        switch (g_logger.async_log_overflow_policy) {
-            case DROP_NEWEST: return false;
-            case DROP_OLDEST: {
-                atomic_fetch_add_explicit(
-                    &g_logger.async_ringbuff.head, 1, memory_order_release
-                );
-                break;
-            }
-            case BLOCK: {
-                while (
-                    (tail -
-                         atomic_load_explicit(
-                             &g_logger.async_ringbuff.head, memory_order_acquire
-                         ) >=
-                     g_logger.async_queue_capacity)
-                ) {
-                    thrd_yield();
-                }
-                break;
-            }
-        }
+// Whether an existing ring may be unlinked to reuse its name: its writer
+// is gone, a previous logger of ours included, and a collector has read
+// everything in it. Anything that is not a ring is left alone.
+static bool dream_shm_stale(const char *name) {
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return errno == ENOENT;
+    struct stat sb;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 &&
+        (size_t)sb.st_size >= sizeof(DreamLogShmHeader))
+        map = mmap(
+            nullptr, sizeof(DreamLogShmHeader), PROT_READ, MAP_SHARED, fd, 0
+        );
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const DreamLogShmHeader *h = map;
+    bool stale = false;
+    if (memcmp(h->magic, DREAM_LOG_SHM_MAGIC, sizeof(h->magic)) == 0 &&
+        h->version == DREAM_LOG_SHM_VERSION) {
+        bool gone = atomic_load_explicit(&h->closed, memory_order_acquire) ||
+                    h->pid == g_logger.pid ||
+                    (kill((pid_t)h->pid, 0) != 0 && errno == ESRCH);
+        stale = gone &&
+                atomic_load_explicit(&h->head, memory_order_acquire) ==
+                    atomic_load_explicit(&h->tail, memory_order_acquire);
     }
+    munmap(map, sizeof(DreamLogShmHeader));
+    return stale;
+}
 
-    g_logger.async_ringbuff.buffer[tail % g_logger.async_queue_capacity] = *log;
-
-    // TODO: Wake up the worker thread only when
-    // more than 90% of the async ring buffer is full.
-    mtx_lock(&g_logger.sleep_mutex);
-    cnd_signal(&g_logger.sleep_cond);
-    mtx_unlock(&g_logger.sleep_mutex);
+static bool dream_shm_init(const DreamLoggerConfig *config) {
+    DreamLogShm *s    = &g_logger.shm;
+    uint64_t capacity = DREAM_LOG_MIN_SHM_BYTES;
+    uint64_t want =
+        config->shm_bytes ? config->shm_bytes : DREAM_LOG_DEFAULT_SHM_BYTES;
+    while (capacity < want) capacity <<= 1;
+
+    char base[NAME_MAX - 4];
+    if (config->shm_name)
+        snprintf(base, sizeof(base), "%s", config->shm_name);
+    else
+        snprintf(
+            base, sizeof(base), "/" DREAM_LOG_SHM_PREFIX "%u", g_logger.pid
+        );
+    // A name taken by a live process, or by a ring a collector has yet to
+    // read, is not taken over; the next suffix is tried instead.
+    int fd = -1;
+    for (int i = 0; fd < 0 && i < DREAM_LOG_SHM_NAME_TRIES; ++i) {
+        if (i)
+            snprintf(s->name, sizeof(s->name), "%s.%d", base, i);
+        else
+            snprintf(s->name, sizeof(s->name), "%s", base);
+        fd = shm_open(s->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd >= 0) break;
+        if (errno != EEXIST) return false;
+        if (dream_shm_stale(s->name)) {
+            shm_unlink(s->name);
+            fd = shm_open(
+                s->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600
+            );
+        }
+    }
+    if (fd < 0) return false;
+
+    size_t size = DREAM_LOG_SHM_HEADER_SIZE + capacity;
+    void *map   = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+        map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(s->name);
+        return false;
+    }
 
+    // A fresh object reads as zeros, positions included.
+    DreamLogShmHeader *header = map;
+    memcpy(header->magic, DREAM_LOG_SHM_MAGIC, sizeof(header->magic));
+    header->version     = DREAM_LOG_SHM_VERSION;
+    header->header_size = DREAM_LOG_SHM_HEADER_SIZE;
+    header->capacity    = capacity;
+    header->pid         = g_logger.pid;
+    atomic_thread_fence(memory_order_release);
+
+    mtx_init(&s->lock, mtx_plain);
+    s->header = header;
+    s->size   = size;
     return true;
 }
 
-static void dream_ring_buffer_push(const char *line) {
-    DreamRingBuffer *r = &g_logger.ring;
-
-    if (!r->buffer) return;
+// A ring with records nobody has read yet stays behind, so that a collector
+// that has not found it yet still can; the collector unlinks it once done.
+static void dream_shm_shutdown(void) {
+    DreamLogShm *s = &g_logger.shm;
+    if (!s->header) return;
+    atomic_store_explicit(&s->header->closed, 1, memory_order_release);
+    if (atomic_load_explicit(&s->header->head, memory_order_acquire) ==
+        atomic_load_explicit(&s->header->tail, memory_order_relaxed))
+        shm_unlink(s->name);
+    munmap(s->header, s->size);
+    mtx_destroy(&s->lock);
+    s->header = nullptr;
+}
 
-    char *dst = r->buffer + (r->head * r->line_len);
-    strncpy(dst, line, r->line_len - 1);
-    dst[r->line_len - 1] = '\0';
+static void dream_shm_write(DreamLogShm *s, const DreamLogMsg *log) {
+    DreamLogShmHeader *h = s->header;
+    size_t category_len  = strlen(log->category);
+    if (category_len > UINT8_MAX) category_len = UINT8_MAX;
+    size_t message_len = strlen(log->message);
+    uint32_t size      = (uint32_t)((sizeof(DreamLogShmRecord) +
+                                category_len + message_len + 7) &
+                               ~(size_t)7);
+
+    uint64_t tail   = atomic_load_explicit(&h->tail, memory_order_relaxed);
+    uint64_t head   = atomic_load_explicit(&h->head, memory_order_acquire);
+    uint64_t to_end = h->capacity - (tail & (h->capacity - 1));
+    uint64_t need   = size <= to_end ? size : to_end + size;
+    if (tail + need - head > h->capacity) {
+        atomic_fetch_add_explicit(&h->dropped, 1, memory_order_relaxed);
+        return;
+    }
 
-    r->head = (r->head + 1) % r->capacity;
-    if (r->count < r->capacity) r->count++;
+    if (size > to_end) {
+        DreamLogShmRecord *pad = _dream_log_shm_record(h, tail);
+        pad->size              = (uint32_t)to_end;
+        pad->kind              = DREAM_LOG_SHM_PAD;
+        tail += to_end;
+    }
+    DreamLogShmRecord *rec = _dream_log_shm_record(h, tail);
+    rec->size              = size;
+    rec->kind              = DREAM_LOG_SHM_RECORD;
+    rec->level             = (uint8_t)log->level;
+    rec->category_len      = (uint8_t)category_len;
+    rec->threadid          = log->threadid;
+    rec->message_len       = (uint32_t)message_len;
+    rec->wall_ns           = dream_log_wall_ns(log->timestamp);
+    memcpy(rec->text, log->category, category_len);
+    memcpy(rec->text + category_len, log->message, message_len);
+
+    atomic_store_explicit(&h->tail, tail + size, memory_order_release);
 }
 
-static void __get_formatted_log(
-    const DreamLogMsg *log, char *output_buffer, size_t output_buffer_size
+static void dream_mapped_emit(
+    DreamLogMappedFile *m, DreamLogLevel level, struct iovec *parts, int count
 ) {
-    char time_buf[32] = {0};
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) total += parts[i].iov_len;
+
+    if (!g_logger.async_enabled) mtx_lock(&m->lock);
+    if (m->map &&
+        (m->used + total > m->size ||
+         (m->max_age_ns && m->used &&
+          dream_coarse_ns() - m->opened_ns >= m->max_age_ns))) {
+        dream_mapped_close(m);
+        dream_mapped_shift(m);
+        dream_mapped_open(m); // on failure the file output goes quiet
+    }
+    if (m->map) {
+        // A line longer than a whole segment is cut off.
+        for (int i = 0; i < count && m->used < m->size; ++i) {
+            size_t n = parts[i].iov_len;
+            if (n > m->size - m->used) n = m->size - m->used;
+            memcpy(m->map + m->used, parts[i].iov_base, n);
+            m->used += n;
+        }
+        if (m->sync == DREAM_LOG_FILE_SYNC_LEVEL && level >= m->sync_level)
+            dream_mapped_sync(m);
+        else if (!g_logger.async_enabled)
+            dream_mapped_maybe_sync(m); // no worker to run the timer
+    }
+    if (!g_logger.async_enabled) mtx_unlock(&m->lock);
+}
 
-    if (g_logger.show_time) {
-        dream_time_string(time_buf, sizeof(time_buf));
+#if defined(DREAM_PLATFORM_LINUX)
+static int dream_uring_enter(int fd, uint32_t submit, uint32_t wait) {
+    int r;
+    do {
+        r = (int)syscall(
+            __NR_io_uring_enter,
+            fd,
+            submit,
+            wait,
+            wait ? IORING_ENTER_GETEVENTS : 0,
+            nullptr,
+            0
+        );
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+static void dream_fd_pwrite_all(int fd, const char *data, size_t n, off_t at) {
+    while (n) {
+        ssize_t written = pwrite(fd, data, n, at);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        at += written;
+        n -= (size_t)written;
     }
+}
 
-    int offset = 0;
+// Retires finished writes; a short or failed one is completed with pwrite.
+static void dream_uring_reap(DreamLogUring *u, bool wait) {
+    if (wait) dream_uring_enter(u->fd, 0, 1);
+    uint32_t head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        DreamLogUringBuffer *buf       = &u->buffers[cqe->user_data];
+        size_t done                    = cqe->res > 0 ? (size_t)cqe->res : 0;
+        if (done < buf->len)
+            dream_fd_pwrite_all(
+                u->file_fd,
+                buf->data + done,
+                buf->len - done,
+                (off_t)(buf->offset + done)
+            );
+        buf->busy = false;
+    }
+    atomic_store_explicit(u->cq_head, head, memory_order_release);
+}
 
-    if (g_logger.show_time)
-        offset += snprintf(
-            output_buffer + offset,
-            output_buffer_size - offset,
-            "[%s] ",
-            time_buf
+// Submits the filled buffer behind `b` and hands it a free one.
+static void dream_uring_submit(DreamLogUring *u, DreamLogWriteBuffer *b) {
+    DreamLogUringBuffer *buf = &u->buffers[u->current];
+    buf->len                 = b->used;
+    buf->offset              = u->offset;
+    buf->busy                = true;
+    u->offset += b->used;
+
+    uint32_t tail = atomic_load_explicit(u->sq_tail, memory_order_relaxed);
+    uint32_t slot = tail & u->sq_mask;
+    u->sqes[slot] = (struct io_uring_sqe){
+        .opcode    = u->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+        .fd        = u->file_fd,
+        .off       = buf->offset,
+        .addr      = (uintptr_t)buf->data,
+        .len       = (uint32_t)buf->len,
+        .buf_index = (uint16_t)u->current,
+        .user_data = u->current,
+    };
+    u->sq_array[slot] = slot;
+    atomic_store_explicit(u->sq_tail, tail + 1, memory_order_release);
+    // The ring holds one entry per buffer, so it never overflows; EAGAIN
+    // and EBUSY mean the kernel wants completions reaped first.
+    while (dream_uring_enter(u->fd, 1, 0) < 0 &&
+           (errno == EAGAIN || errno == EBUSY))
+        dream_uring_reap(u, true);
+
+    dream_uring_reap(u, false);
+    for (;;) {
+        for (uint32_t i = 0; i < u->buffer_count; ++i) {
+            if (u->buffers[i].busy) continue;
+            u->current = i;
+            b->data    = u->buffers[i].data;
+            b->used    = 0;
+            return;
+        }
+        dream_uring_reap(u, true);
+    }
+}
+
+// Waits for writes in flight, then releases the ring and its buffers.
+static void dream_uring_shutdown(DreamLogUring *u) {
+    if (u->cq_tail) {
+        for (;;) {
+            bool busy = false;
+            for (uint32_t i = 0; i < u->buffer_count; ++i)
+                busy |= u->buffers[i].busy;
+            if (!busy) break;
+            dream_uring_reap(u, true);
+        }
+    }
+    if (u->sqes) munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring) munmap(u->sq_ring, u->sq_ring_size);
+    if (u->fd >= 0) close(u->fd);
+    if (u->buffers) {
+        for (uint32_t i = 0; i < u->buffer_count; ++i)
+            _dream_free(
+                DREAM_MEMORY_LOGGER, u->buffers[i].data, u->buffer_capacity
+            );
+        _dream_free(
+            DREAM_MEMORY_LOGGER,
+            u->buffers,
+            u->buffer_slots * sizeof(DreamLogUringBuffer)
         );
+    }
+    *u = (DreamLogUring){.fd = -1};
+}
 
-    offset += snprintf(
-        output_buffer + offset,
-        output_buffer_size - offset,
-        "[%s] ",
-        dream_log_level_string(log->level)
+static void *dream_uring_map(int fd, size_t size, off_t what) {
+    void *p = mmap(
+        nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        what
     );
+    return p == MAP_FAILED ? nullptr : p;
+}
 
-    offset += snprintf(
-        output_buffer + offset,
-        output_buffer_size - offset,
-        "[%s] ",
-        log->category
+static bool dream_uring_init(
+    DreamLogUring *u, int file_fd, uint32_t count, size_t capacity
+) {
+    struct io_uring_params params = {0};
+    *u = (DreamLogUring){.fd = -1, .file_fd = file_fd};
+    u->fd = (int)syscall(__NR_io_uring_setup, count, &params);
+    if (u->fd < 0) return false;
+
+    u->sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    u->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_size > u->sq_ring_size)
+            u->sq_ring_size = u->cq_ring_size;
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = dream_uring_map(u->fd, u->sq_ring_size, IORING_OFF_SQ_RING);
+    u->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP)
+        ? u->sq_ring
+        : dream_uring_map(u->fd, u->cq_ring_size, IORING_OFF_CQ_RING);
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes      = dream_uring_map(u->fd, u->sqes_size, IORING_OFF_SQES);
+    u->buffers   = _dream_calloc(
+        DREAM_MEMORY_LOGGER, count * sizeof(DreamLogUringBuffer), 0
     );
+    u->buffer_slots    = count;
+    u->buffer_capacity = capacity;
+    if (!u->sq_ring || !u->cq_ring || !u->sqes || !u->buffers) {
+        dream_uring_shutdown(u);
+        return false;
+    }
 
-    if (g_logger.show_thread)
-        offset += snprintf(
-            output_buffer + offset,
-            output_buffer_size - offset,
-            "[T:%u] ",
-            dream_thread_id()
-        );
+    char *sq     = u->sq_ring;
+    char *cq     = u->cq_ring;
+    u->sq_tail   = (_Atomic uint32_t *)(sq + params.sq_off.tail);
+    u->sq_mask   = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    u->sq_array  = (uint32_t *)(sq + params.sq_off.array);
+    u->cq_head   = (_Atomic uint32_t *)(cq + params.cq_off.head);
+    u->cq_tail   = (_Atomic uint32_t *)(cq + params.cq_off.tail);
+    u->cq_mask   = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    u->cqes      = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    struct iovec iov[count];
+    for (u->buffer_count = 0; u->buffer_count < count; ++u->buffer_count) {
+        char *data = _dream_alloc(DREAM_MEMORY_LOGGER, capacity, 0);
+        if (!data) break;
+        u->buffers[u->buffer_count].data = data;
+        iov[u->buffer_count]             = (struct iovec){data, capacity};
+    }
+    if (u->buffer_count == 0) {
+        dream_uring_shutdown(u);
+        return false;
+    }
+    // Registration pins the buffers and can fail on a small
+    // RLIMIT_MEMLOCK; plain IORING_OP_WRITE works without it.
+    u->fixed = syscall(
+                   __NR_io_uring_register,
+                   u->fd,
+                   IORING_REGISTER_BUFFERS,
+                   iov,
+                   u->buffer_count
+               ) == 0;
+    return true;
+}
+#endif
 
-    snprintf(
-        output_buffer + offset,
-        output_buffer_size - offset,
-        "%s\n",
-        log->message
-    );
+static void dream_output_flush(DreamLogWriteBuffer *b) {
+    if (b->used == 0) return;
+#if defined(DREAM_PLATFORM_LINUX)
+    if (b == &g_logger.out[DREAM_LOG_OUT_FILE] && g_logger.uring.fd >= 0) {
+        dream_uring_submit(&g_logger.uring, b);
+        return;
+    }
+#endif
+    dream_fd_write_all(b->fd, b->data, b->used);
+    b->used = 0;
 }
 
-static void
-_dream_sink_stdout_write(DreamLoggerSink *this, const DreamLogMsg *log) {
-    char formatted_line[1400];
-    __get_formatted_log(log, formatted_line, sizeof(formatted_line));
-    dream_set_color(log->level);
-    dream_write_stdout(formatted_line);
-    dream_reset_color();
+static void dream_output_flush_all(void) {
+    for (int i = 0; i < DREAM_LOG_OUT_COUNT; ++i)
+        if (g_logger.out[i].fd >= 0 && !g_logger.out[i].isolated)
+            dream_output_flush(&g_logger.out[i]);
+    if (!g_logger.out[DREAM_LOG_OUT_FILE].isolated)
+        dream_mapped_maybe_sync(&g_logger.mapped);
+    g_logger.flush_pending = false;
+    g_logger.last_flush_ns = dream_monotonic_ns();
 }
-static void
-_dream_sink_stderr_write(DreamLoggerSink *this, const DreamLogMsg *log) {
-    char formatted_line[1400];
-    __get_formatted_log(log, formatted_line, sizeof(formatted_line));
-    dream_set_color(log->level);
-    dream_write_stdout(formatted_line);
-    dream_reset_color();
+
+// Called by the worker after every drain pass.
+static void dream_output_maybe_flush(void) {
+    if (g_logger.flush_pending ||
+        dream_monotonic_ns() - g_logger.last_flush_ns >=
+            g_logger.flush_interval_ns)
+        dream_output_flush_all();
 }
-static void
-_dream_sink_file_write(DreamLoggerSink *this, const DreamLogMsg *log) {
-    char formatted_line[1400];
-    __get_formatted_log(log, formatted_line, sizeof(formatted_line));
-    dream_write_file(formatted_line);
+
+// Writes one line, made of `count` pieces, to an output.
+static void dream_output_emit(
+    DreamLogOutput which, DreamLogLevel level, struct iovec *parts, int count
+) {
+    if (which == DREAM_LOG_OUT_FILE && g_logger.mapped.path) {
+        dream_mapped_emit(&g_logger.mapped, level, parts, count);
+        return;
+    }
+    DreamLogWriteBuffer *b = &g_logger.out[which];
+    if (b->fd < 0) return;
+
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) total += parts[i].iov_len;
+
+    if (!g_logger.async_enabled || !b->data || total > b->capacity) {
+        dream_output_flush(b); // keep ordering with anything buffered
+        dream_fd_writev_all(b->fd, parts, count);
+        return;
+    }
+
+    if (b->used + total > b->capacity) dream_output_flush(b);
+    for (int i = 0; i < count; ++i) {
+        memcpy(b->data + b->used, parts[i].iov_base, parts[i].iov_len);
+        b->used += parts[i].iov_len;
+    }
+    if (level >= g_logger.flush_level) {
+        if (b->isolated)
+            b->flush_pending = true;
+        else
+            g_logger.flush_pending = true;
+    }
 }
-static void
-_dream_sink_ringbuff_write(DreamLoggerSink *this, const DreamLogMsg *log) {
-    char formatted_line[1400];
-    __get_formatted_log(log, formatted_line, sizeof(formatted_line));
-    dream_ring_buffer_push(formatted_line);
+
+static void dream_output_emit_line(
+    DreamLogOutput which,
+    DreamLogLevel level,
+    const char *line,
+    size_t len,
+    bool colored
+) {
+    static const char reset[] = "\033[0m";
+    const char *color         = dream_log_level_color_ansi(level);
+
+    struct iovec parts[3];
+    int count = 0;
+    if (colored) {
+        parts[count++] = (struct iovec){(void *)color, strlen(color)};
+    }
+    parts[count++] = (struct iovec){(void *)line, len};
+    if (colored) {
+        parts[count++] = (struct iovec){(void *)reset, sizeof(reset) - 1};
+    }
+    dream_output_emit(which, level, parts, count);
 }
-static void
-_dream_sink_callback_write(DreamLoggerSink *this, const DreamLogMsg *log) {
-    char formatted_line[1400];
-    __get_formatted_log(log, formatted_line, sizeof(formatted_line));
-    g_logger.callback(
-        log->level,
-        log->category,
-        log->message,
-        formatted_line,
-        g_logger.callback_user_data
-    );
+
+static void dream_dispatch(DreamLogMsg *log);
+static void dream_dispatch_isolated(DreamLoggerSink *sink, DreamLogMsg *log);
+static void dream_log_sites_report(bool direct);
+
+static inline DreamLogRecord *
+dream_async_record_at(DLMRingBuffer *q, size_t pos) {
+    return (DreamLogRecord *)(q->buffer + (pos & (q->cell_count - 1)) *
+                                              DREAM_LOG_CELL_SIZE);
 }
 
-void DreamLoggerInit(const DreamLoggerConfig *config) {
-    memset(&g_logger, 0, sizeof(g_logger));
+// Copies to/from the payload of the record starting at cell `pos`, splitting
+// the copy where the payload wraps around the end of the ring.
+static void dream_async_payload_write(
+    DLMRingBuffer *q, size_t pos, const void *src, size_t n
+) {
+    size_t size      = q->cell_count * DREAM_LOG_CELL_SIZE;
+    size_t offset    = ((pos & (q->cell_count - 1)) * DREAM_LOG_CELL_SIZE +
+                     sizeof(DreamLogRecord)) &
+                    (size - 1);
+    size_t first = (n < size - offset) ? n : size - offset;
+    memcpy(q->buffer + offset, src, first);
+    memcpy(q->buffer, (const uint8_t *)src + first, n - first);
+}
 
-    g_logger.enabled                           = config->enabled;
-    g_logger.use_color                         = config->use_color;
-    g_logger.use_emoji                         = config->use_emoji;
-    g_logger.show_time                         = config->show_time;
-    g_logger.show_thread                       = config->show_thread;
-    g_logger.global_min_log_level              = config->global_min_log_level;
-    g_logger.initialized                       = true;
-    g_logger.ring.initialized                  = false;
-    g_logger.ring.dump_after_async_thread_join = false;
+static void
+dream_async_payload_read(DLMRingBuffer *q, size_t pos, void *dst, size_t n) {
+    size_t size      = q->cell_count * DREAM_LOG_CELL_SIZE;
+    size_t offset    = ((pos & (q->cell_count - 1)) * DREAM_LOG_CELL_SIZE +
+                     sizeof(DreamLogRecord)) &
+                    (size - 1);
+    size_t first = (n < size - offset) ? n : size - offset;
+    memcpy(dst, q->buffer + offset, first);
+    memcpy((uint8_t *)dst + first, q->buffer, n - first);
+}
 
-#ifdef DREAM_PLATFORM_WIN32
-    g_logger.console = GetStdHandle(STD_OUTPUT_HANDLE);
-    CONSOLE_SCREEN_BUFFER_INFO info;
-    GetConsoleScreenBufferInfo(g_logger.console, &info);
-    g_logger.default_attributes = info.wAttributes;
-#endif
+static inline _Atomic size_t *dream_async_seq_at(DLMRingBuffer *q, size_t pos) {
+    return &q->seq[pos & (q->cell_count - 1)];
+}
 
-    g_logger.sinks      = config->sinks;
-    g_logger.sink_count = config->sink_count;
+// Claims `cells` consecutive free cells at the tail. Returns false when the
+// queue has no room for them.
+static bool
+dream_async_claim_tail(DLMRingBuffer *q, size_t cells, size_t *out_pos) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
 
-    for (size_t i = 0; i < g_logger.sink_count; ++i) {
-        DreamLoggerSink *sink = g_logger.sinks[i];
-        switch (sink->sink_into) {
-            case DREAM_LOG_SINK_STDOUT: {
-                sink->__write = _dream_sink_stdout_write;
-                break;
+    for (;;) {
+        intptr_t diff = 0;
+        for (size_t i = 0; i < cells && diff == 0; ++i) {
+            size_t seq = atomic_load_explicit(
+                dream_async_seq_at(q, tail + i), memory_order_acquire
+            );
+            diff = (intptr_t)(seq - (tail + i));
+        }
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &q->tail,
+                    &tail,
+                    tail + cells,
+                    memory_order_relaxed,
+                    memory_order_relaxed
+                )) {
+                *out_pos = tail;
+                return true;
             }
-            case DREAM_LOG_SINK_STDERR: {
+        } else if (diff < 0) {
+            return false; // still held by the previous lap
+        } else {
+            tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Claims the oldest published record. Returns false when the queue is empty or
+// its oldest record is still being copied in.
+static bool dream_async_claim_head(
+    DLMRingBuffer *q, size_t *out_pos, uint32_t *out_cells
+) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    for (;;) {
+        size_t seq = atomic_load_explicit(
+            dream_async_seq_at(q, head), memory_order_acquire
+        );
+        intptr_t diff = (intptr_t)(seq - (head + 1));
+
+        if (diff < 0) return false;
+        if (diff > 0) {
+            head = atomic_load_explicit(&q->head, memory_order_relaxed);
+            continue;
+        }
+
+        uint32_t cells = atomic_load_explicit(
+            &dream_async_record_at(q, head)->cells, memory_order_relaxed
+        );
+        if (atomic_compare_exchange_weak_explicit(
+                &q->head,
+                &head,
+                head + cells,
+                memory_order_relaxed,
+                memory_order_relaxed
+            )) {
+            *out_pos   = head;
+            *out_cells = cells;
+            return true;
+        }
+    }
+}
+
+static void dream_async_release(DLMRingBuffer *q, size_t pos, uint32_t cells) {
+    for (uint32_t i = 0; i < cells; ++i)
+        atomic_store_explicit(
+            dream_async_seq_at(q, pos + i),
+            pos + i + q->cell_count,
+            memory_order_release
+        );
+}
+
+static inline bool dream_async_queue_empty(DLMRingBuffer *q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) ==
+           atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+static bool dream_async_all_queues_empty(void) {
+    if (!dream_async_queue_empty(&g_logger.async_ringbuff)) return false;
+    for (DreamLogThreadQueue *tq = atomic_load_explicit(
+             &g_logger.thread_queues, memory_order_acquire
+         );
+         tq;
+         tq = tq->next) {
+        if (!dream_async_queue_empty(&tq->ring)) return false;
+    }
+    return true;
+}
+
+static uint32_t dream_latency_bucket(uint64_t ns) {
+    if (ns < 8) return (uint32_t)ns;
+    uint32_t msb    = 63 - (uint32_t)__builtin_clzll(ns);
+    uint32_t bucket = (msb - 2) * 8 + (uint32_t)((ns >> (msb - 3)) & 7);
+    return bucket < DREAM_LOG_LATENCY_BUCKETS ? bucket
+                                              : DREAM_LOG_LATENCY_BUCKETS - 1;
+}
+
+static inline void dream_stats_bump(_Atomic uint64_t *counter, uint64_t by) {
+    atomic_store_explicit(
+        counter,
+        atomic_load_explicit(counter, memory_order_relaxed) + by,
+        memory_order_relaxed
+    );
+}
+
+static void dream_stats_record_latency(uint64_t timestamp, uint64_t now) {
+    uint64_t then_ns = dream_log_wall_ns(timestamp);
+    uint64_t now_ns  = dream_log_wall_ns(now);
+    uint64_t ns      = now_ns > then_ns ? now_ns - then_ns : 0;
+    dream_stats_bump(&g_logger.stats_latency[dream_latency_bucket(ns)], 1);
+    if (ns > atomic_load_explicit(
+                 &g_logger.stats_latency_max_ns, memory_order_relaxed
+             ))
+        atomic_store_explicit(
+            &g_logger.stats_latency_max_ns, ns, memory_order_relaxed
+        );
+}
+
+// Consumes up to `max` records from `q` and hands them to the sinks, or
+// only to `isolated` when draining that sink's backlog.
+static size_t
+dream_async_drain(DLMRingBuffer *q, size_t max, DreamLoggerSink *isolated) {
+    size_t drained = 0;
+    size_t pos;
+    uint32_t cells;
+
+    // A pass starts when the queue is at its fullest.
+    size_t used = atomic_load_explicit(&q->tail, memory_order_relaxed) -
+                  atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (used > atomic_load_explicit(&q->high_water, memory_order_relaxed) &&
+        used <= q->cell_count)
+        atomic_store_explicit(&q->high_water, used, memory_order_relaxed);
+
+    while (drained < max && dream_async_claim_head(q, &pos, &cells)) {
+        const DreamLogRecord *rec = dream_async_record_at(q, pos);
+        DreamLogMsg msg;
+        char args[DREAM_LOG_MAX_MESSAGE];
+        msg.level     = rec->level;
+        msg.timestamp =
+            atomic_load_explicit(&rec->timestamp, memory_order_relaxed);
+        msg.threadid    = rec->threadid;
+        msg.pid         = rec->pid;
+        msg.category_id = rec->category;
+        msg.category    = dream_log_category_name(rec->category);
+        msg.fmt         = rec->fmt;
+        msg.args        = args;
+        msg.args_size   = 0;
+        msg.has_text    = !msg.fmt;
+
+        // Packed args are formatted by dream_dispatch, and only if a sink
+        // wants the text.
+        uint32_t payload_size = rec->payload_size;
+        if (msg.fmt) {
+            dream_async_payload_read(q, pos, args, payload_size);
+            msg.args_size = payload_size;
+        } else {
+            dream_async_payload_read(q, pos, msg.message, payload_size);
+        }
+        dream_async_release(q, pos, cells);
+
+        if (isolated) {
+            dream_dispatch_isolated(isolated, &msg);
+        } else {
+            dream_stats_record_latency(msg.timestamp, dream_log_now());
+            dream_dispatch(&msg);
+        }
+        ++drained;
+    }
+
+    if (drained && !isolated)
+        dream_stats_bump(&g_logger.stats_written, drained);
+    return drained;
+}
+
+static inline void dream_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+#if defined(DREAM_PLATFORM_LINUX)
+
+// Sleeps while *word == expected, for at most timeout_ns (0: no timeout).
+static void dream_futex_wait(
+    _Atomic uint32_t *word, uint32_t expected, uint64_t timeout_ns
+) {
+    struct timespec ts = {
+        .tv_sec  = (time_t)(timeout_ns / 1000000000u),
+        .tv_nsec = (long)(timeout_ns % 1000000000u),
+    };
+    syscall(
+        SYS_futex,
+        word,
+        FUTEX_WAIT_PRIVATE,
+        expected,
+        timeout_ns ? &ts : nullptr,
+        nullptr,
+        0
+    );
+}
+
+static void dream_futex_wake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+#else
+
+static void dream_futex_wait(
+    _Atomic uint32_t *word, uint32_t expected, uint64_t timeout_ns
+) {
+    mtx_lock(&g_logger.sleep_mutex);
+    if (atomic_load_explicit(word, memory_order_relaxed) == expected) {
+        if (timeout_ns) {
+            struct timespec ts;
+            timespec_get(&ts, TIME_UTC);
+            uint64_t ns = (uint64_t)ts.tv_nsec + timeout_ns;
+            ts.tv_sec += (time_t)(ns / 1000000000u);
+            ts.tv_nsec = (long)(ns % 1000000000u);
+            cnd_timedwait(&g_logger.sleep_cond, &g_logger.sleep_mutex, &ts);
+        } else {
+            cnd_wait(&g_logger.sleep_cond, &g_logger.sleep_mutex);
+        }
+    }
+    mtx_unlock(&g_logger.sleep_mutex);
+}
+
+// Isolated sink threads wait on the same condition as the worker.
+static void dream_futex_wake(_Atomic uint32_t *word) {
+    mtx_lock(&g_logger.sleep_mutex);
+    cnd_broadcast(&g_logger.sleep_cond);
+    mtx_unlock(&g_logger.sleep_mutex);
+}
+
+#endif
+
+static void dream_async_unpark(_Atomic uint32_t *worker, uint32_t seen_state) {
+    if (seen_state != DREAM_LOG_WORKER_RUNNING &&
+        atomic_compare_exchange_strong_explicit(
+            worker,
+            &seen_state,
+            DREAM_LOG_WORKER_RUNNING,
+            memory_order_relaxed,
+            memory_order_relaxed
+        ))
+        dream_futex_wake(worker);
+}
+
+// Wakes the worker if it is parked. Callers must have made their record (or
+// shutdown request) visible before the fence.
+static void dream_async_wake_worker(void) {
+    atomic_thread_fence(memory_order_seq_cst);
+    dream_async_unpark(
+        &g_logger.worker_state,
+        atomic_load_explicit(&g_logger.worker_state, memory_order_relaxed)
+    );
+}
+
+// Rings the doorbell of the thread consuming `q` (whose state word is
+// `worker`) for a record just published at the end of `q`.
+static void dream_async_doorbell(
+    DLMRingBuffer *q, size_t tail, _Atomic uint32_t *worker
+) {
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t state = atomic_load_explicit(worker, memory_order_relaxed);
+    if (state == DREAM_LOG_WORKER_RUNNING) return;
+
+    if (state == DREAM_LOG_WORKER_PARKED_TIMED) {
+        size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+        if ((tail - head) * 100 <
+            q->cell_count * g_logger.async_wake_fill_percent)
+            return; // picked up at the latency deadline
+    }
+
+    dream_async_unpark(worker, state);
+}
+
+static void dream_async_park_worker(DreamLogWorkerState how) {
+    atomic_store_explicit(&g_logger.worker_state, how, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // Re-check after announcing the park; pairs with the producer's fence.
+    if (dream_async_all_queues_empty() &&
+        atomic_load_explicit(
+            &g_logger.async_thread_running, memory_order_relaxed
+        )) {
+        dream_futex_wait(
+            &g_logger.worker_state,
+            how,
+            how == DREAM_LOG_WORKER_PARKED_TIMED
+                ? g_logger.async_wake_latency_ns
+                : 0
+        );
+    }
+
+    atomic_store_explicit(
+        &g_logger.worker_state, DREAM_LOG_WORKER_RUNNING, memory_order_relaxed
+    );
+}
+
+// Round-robin over the shared queue and every per-thread queue, a bounded
+// batch at a time so one busy thread cannot starve the rest.
+static size_t dream_async_drain_round_robin(void) {
+    size_t drained = dream_async_drain(
+        &g_logger.async_ringbuff, DREAM_LOG_DRAIN_BATCH, nullptr
+    );
+    for (DreamLogThreadQueue *tq = atomic_load_explicit(
+             &g_logger.thread_queues, memory_order_acquire
+         );
+         tq;
+         tq = tq->next) {
+        drained +=
+            dream_async_drain(&tq->ring, DREAM_LOG_DRAIN_BATCH, nullptr);
+    }
+    return drained;
+}
+
+// Reads the timestamp of the oldest published record of `q` without
+// consuming it.
+static bool dream_async_peek_timestamp(DLMRingBuffer *q, uint64_t *out) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t seq =
+        atomic_load_explicit(dream_async_seq_at(q, head), memory_order_acquire);
+    if (seq != head + 1) return false;
+    *out = atomic_load_explicit(
+        &dream_async_record_at(q, head)->timestamp, memory_order_relaxed
+    );
+    return true;
+}
+
+// Merges the queues by always taking the oldest head that is available.
+// Records still being copied in are not waited for, so ordering is exact
+// only among records already published.
+static size_t dream_async_drain_by_timestamp(size_t max) {
+    size_t drained = 0;
+
+    while (drained < max) {
+        DLMRingBuffer *oldest = nullptr;
+        uint64_t oldest_ts    = 0;
+        uint64_t ts;
+
+        if (dream_async_peek_timestamp(&g_logger.async_ringbuff, &ts)) {
+            oldest    = &g_logger.async_ringbuff;
+            oldest_ts = ts;
+        }
+        for (DreamLogThreadQueue *tq = atomic_load_explicit(
+                 &g_logger.thread_queues, memory_order_acquire
+             );
+             tq;
+             tq = tq->next) {
+            if (dream_async_peek_timestamp(&tq->ring, &ts) &&
+                (!oldest || (int64_t)(ts - oldest_ts) < 0)) {
+                oldest    = &tq->ring;
+                oldest_ts = ts;
+            }
+        }
+
+        if (!oldest || !dream_async_drain(oldest, 1, nullptr)) break;
+        ++drained;
+    }
+
+    return drained;
+}
+
+static int DreamAsyncWorkerFn(void *args) {
+    DreamLoggerInstallSignalStack();
+    bool had_work = false;
+
+    for (;;) {
+        size_t drained =
+            g_logger.async_drain_order == DREAM_LOG_DRAIN_TIMESTAMP
+                ? dream_async_drain_by_timestamp(DREAM_LOG_DRAIN_BATCH)
+                : dream_async_drain_round_robin();
+        if (drained) {
+            had_work = true;
+            dream_output_maybe_flush();
+            continue;
+        }
+
+        if (!dream_async_all_queues_empty()) {
+            // Claimed by a producer that is still copying it in.
+            thrd_yield();
+            continue;
+        }
+
+        // No work available
+        if ((g_logger.rate_interval_ns || g_logger.collapse_repeats) &&
+            dream_coarse_ns() - g_logger.last_site_sweep_ns >=
+                g_logger.collapse_window_ns) {
+            dream_log_sites_report(true);
+            g_logger.last_site_sweep_ns = dream_coarse_ns();
+        }
+        dream_output_flush_all();
+        if (!atomic_load_explicit(
+                &g_logger.async_thread_running, memory_order_acquire
+            ))
+            break;
+
+        uint32_t spins = 0;
+        while (spins < g_logger.async_spin_count &&
+               dream_async_all_queues_empty()) {
+            dream_cpu_relax();
+            ++spins;
+        }
+        if (spins < g_logger.async_spin_count) continue;
+
+        dream_async_park_worker(
+            had_work ? DREAM_LOG_WORKER_PARKED_TIMED
+                     : DREAM_LOG_WORKER_PARKED_IDLE
+        );
+        had_work = false;
+    }
+
+    return 0;
+}
+
+// Number of cells `log` takes up in a queue.
+static size_t
+dream_async_record_cells(const DreamLogMsg *log, uint32_t *payload_size) {
+    *payload_size = log->fmt ? log->args_size
+                             : (uint32_t)strlen(log->message) + 1;
+    return (sizeof(DreamLogRecord) + *payload_size + DREAM_LOG_CELL_SIZE - 1) /
+           DREAM_LOG_CELL_SIZE;
+}
+
+// Copies `log` into the cells claimed at `pos` and hands them to the
+// consumer.
+static void dream_async_publish(
+    DLMRingBuffer *q,
+    size_t pos,
+    size_t cells,
+    uint32_t payload_size,
+    const DreamLogMsg *log
+) {
+    DreamLogRecord *rec = dream_async_record_at(q, pos);
+    atomic_store_explicit(&rec->cells, (uint32_t)cells, memory_order_relaxed);
+    atomic_store_explicit(
+        &rec->timestamp, log->timestamp, memory_order_relaxed
+    );
+    rec->level        = (uint8_t)log->level;
+    rec->threadid     = log->threadid;
+    rec->pid          = log->pid;
+    rec->payload_size = (uint16_t)payload_size;
+    rec->fmt          = log->fmt;
+    rec->category     = log->category_id;
+    dream_async_payload_write(
+        q, pos, log->fmt ? log->args : log->message, payload_size
+    );
+
+    atomic_store_explicit(
+        dream_async_seq_at(q, pos), pos + 1, memory_order_release
+    );
+}
+
+static bool dream_async_push(DLMRingBuffer *q, const DreamLogMsg *log) {
+    uint32_t payload_size;
+    size_t cells = dream_async_record_cells(log, &payload_size);
+
+    size_t pos;
+    uint64_t blocked_since = 0;
+    while (!dream_async_claim_tail(q, cells, &pos)) {
+        dream_async_wake_worker();
+        atomic_store_explicit(
+            &q->high_water, q->cell_count, memory_order_relaxed
+        );
+        switch (g_logger.async_log_overflow_policy) {
+            case DROP_NEWEST:
+                atomic_fetch_add_explicit(
+                    &q->dropped_newest, 1, memory_order_relaxed
+                );
+                return false;
+            case DROP_OLDEST: {
+                size_t oldest;
+                uint32_t oldest_cells;
+                if (dream_async_claim_head(q, &oldest, &oldest_cells)) {
+                    dream_async_release(q, oldest, oldest_cells);
+                    atomic_fetch_add_explicit(
+                        &q->dropped_oldest, 1, memory_order_relaxed
+                    );
+                } else {
+                    thrd_yield();
+                }
+                break;
+            }
+            case BLOCK: {
+                if (!blocked_since) blocked_since = dream_monotonic_ns();
+                thrd_yield();
+                break;
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&q->enqueued, 1, memory_order_relaxed);
+    if (blocked_since) {
+        atomic_fetch_add_explicit(&q->blocked, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(
+            &q->blocked_ns,
+            dream_monotonic_ns() - blocked_since,
+            memory_order_relaxed
+        );
+    }
+
+    dream_async_publish(q, pos, cells, payload_size, log);
+    dream_async_doorbell(q, pos + cells, &g_logger.worker_state);
+
+    return true;
+}
+
+// Called by the worker, the backlog's only producer. Never waits for the
+// sink: a record that does not fit is dropped.
+static void
+dream_sink_worker_push(DreamLogSinkWorker *w, const DreamLogMsg *log) {
+    DLMRingBuffer *q = &w->backlog;
+    uint32_t payload_size;
+    size_t cells = dream_async_record_cells(log, &payload_size);
+
+    size_t pos;
+    if (!dream_async_claim_tail(q, cells, &pos)) {
+        atomic_store_explicit(
+            &q->high_water, q->cell_count, memory_order_relaxed
+        );
+        dream_stats_bump(&q->dropped_newest, 1);
+        dream_async_unpark(
+            &w->state, atomic_load_explicit(&w->state, memory_order_relaxed)
+        );
+        return;
+    }
+    dream_stats_bump(&q->enqueued, 1);
+    dream_async_publish(q, pos, cells, payload_size, log);
+    dream_async_doorbell(q, pos + cells, &w->state);
+}
+
+// Writes out the sink's buffered output on the same terms as the worker
+// does for the other sinks.
+static void dream_sink_worker_flush(DreamLogSinkWorker *w, bool force) {
+    DreamLogWriteBuffer *b = w->out;
+    if (!b) return;
+    uint64_t now = dream_monotonic_ns();
+    if (!force && !b->flush_pending &&
+        now - w->last_flush_ns < g_logger.flush_interval_ns)
+        return;
+    dream_output_flush(b);
+    if (b == &g_logger.out[DREAM_LOG_OUT_FILE])
+        dream_mapped_maybe_sync(&g_logger.mapped);
+    b->flush_pending = false;
+    w->last_flush_ns = now;
+}
+
+static void
+dream_sink_worker_park(DreamLogSinkWorker *w, DreamLogWorkerState how) {
+    atomic_store_explicit(&w->state, how, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (dream_async_queue_empty(&w->backlog) &&
+        atomic_load_explicit(&w->running, memory_order_relaxed)) {
+        dream_futex_wait(
+            &w->state,
+            how,
+            how == DREAM_LOG_WORKER_PARKED_TIMED
+                ? g_logger.async_wake_latency_ns
+                : 0
+        );
+    }
+
+    atomic_store_explicit(
+        &w->state, DREAM_LOG_WORKER_RUNNING, memory_order_relaxed
+    );
+}
+
+// Same spin-then-park cycle as DreamAsyncWorkerFn, over one backlog.
+static int DreamSinkWorkerFn(void *args) {
+    DreamLoggerInstallSignalStack();
+    DreamLogSinkWorker *w = args;
+    bool had_work         = false;
+
+    for (;;) {
+        size_t drained =
+            dream_async_drain(&w->backlog, DREAM_LOG_DRAIN_BATCH, w->sink);
+        if (drained) {
+            dream_stats_bump(&w->written, drained);
+            had_work = true;
+            dream_sink_worker_flush(w, false);
+            continue;
+        }
+
+        if (!dream_async_queue_empty(&w->backlog)) {
+            thrd_yield();
+            continue;
+        }
+
+        dream_sink_worker_flush(w, true);
+        if (!atomic_load_explicit(&w->running, memory_order_acquire)) {
+            // Everything the worker pushed is visible now.
+            if (dream_async_queue_empty(&w->backlog)) break;
+            continue;
+        }
+
+        uint32_t spins = 0;
+        while (spins < g_logger.async_spin_count &&
+               dream_async_queue_empty(&w->backlog)) {
+            dream_cpu_relax();
+            ++spins;
+        }
+        if (spins < g_logger.async_spin_count) continue;
+
+        dream_sink_worker_park(
+            w,
+            had_work ? DREAM_LOG_WORKER_PARKED_TIMED
+                     : DREAM_LOG_WORKER_PARKED_IDLE
+        );
+        had_work = false;
+    }
+
+    return 0;
+}
+
+static bool dream_ring_buffer_init(const DreamLoggerConfig *config) {
+    DreamRingBuffer *r = &g_logger.ring;
+    if (!config->ring_buffer_lines || !config->ring_buffer_line_len)
+        return false;
+
+    uint32_t slot_size =
+        (sizeof(DreamLogFlightSlot) + config->ring_buffer_line_len + 7) & ~7u;
+    size_t size = DREAM_LOG_FLIGHT_HEADER_SIZE +
+                  (size_t)config->ring_buffer_lines * slot_size;
+    void *memory = nullptr;
+    if (config->ring_buffer_path) {
+        // Keep what the previous run recorded.
+        char previous[PATH_MAX];
+        snprintf(
+            previous, sizeof(previous), "%s.prev", config->ring_buffer_path
+        );
+        rename(config->ring_buffer_path, previous);
+
+        int fd = open(
+            config->ring_buffer_path,
+            O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644
+        );
+        if (fd >= 0) {
+            if (posix_fallocate(fd, 0, (off_t)size) == 0 ||
+                ftruncate(fd, (off_t)size) == 0) {
+                memory = mmap(
+                    nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+                );
+                if (memory == MAP_FAILED) memory = nullptr;
+            }
+            close(fd);
+        }
+    }
+    r->mapped = memory != nullptr;
+    if (!memory) memory = _dream_alloc_pages(DREAM_MEMORY_LOGGER, size);
+    if (!memory) return false;
+
+    DreamLogFlightHeader *header = memory;
+    memcpy(header->magic, DREAM_LOG_FLIGHT_MAGIC, sizeof(header->magic));
+    header->version     = DREAM_LOG_FLIGHT_VERSION;
+    header->header_size = DREAM_LOG_FLIGHT_HEADER_SIZE;
+    header->slot_count  = config->ring_buffer_lines;
+    header->slot_size   = slot_size;
+    header->pid         = g_logger.pid;
+    atomic_store_explicit(&header->next, 0, memory_order_release);
+
+    r->header      = header;
+    r->size        = size;
+    r->initialized = true;
+    return true;
+}
+
+static void dream_ring_buffer_shutdown(void) {
+    DreamRingBuffer *r = &g_logger.ring;
+    if (r->mapped)
+        munmap(r->header, r->size);
+    else
+        _dream_free_pages(DREAM_MEMORY_LOGGER, r->header, r->size);
+    r->header      = nullptr;
+    r->initialized = false;
+}
+
+// Safe against any number of concurrent writers. A writer lapped by the
+// whole ring while copying loses its line rather than tearing another.
+static void dream_ring_buffer_push(const char *line, size_t len) {
+    DreamLogFlightHeader *header = g_logger.ring.header;
+    if (!header) return;
+
+    uint64_t seq =
+        atomic_fetch_add_explicit(&header->next, 1, memory_order_relaxed);
+    DreamLogFlightSlot *slot = _dream_log_flight_slot(header, seq);
+    size_t cap               = header->slot_size - sizeof(DreamLogFlightSlot);
+    if (len > cap) len = cap;
+
+    atomic_store_explicit(&slot->seq, 2 * seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(slot->text, line, len);
+    slot->len = (uint32_t)len;
+    atomic_store_explicit(&slot->seq, 2 * seq + 2, memory_order_release);
+}
+
+static size_t __get_formatted_log(
+    const DreamLogMsg *log, char *output_buffer, size_t output_buffer_size
+) {
+    char time_buf[32] = {0};
+
+    if (g_logger.show_time) {
+        dream_time_string(log->timestamp, time_buf, sizeof(time_buf));
+    }
+
+    int offset = 0;
+
+    if (g_logger.show_time)
+        offset += snprintf(
+            output_buffer + offset,
+            output_buffer_size - offset,
+            "[%s] ",
+            time_buf
+        );
+
+    offset += snprintf(
+        output_buffer + offset,
+        output_buffer_size - offset,
+        "[%s] ",
+        dream_log_level_string(log->level)
+    );
+
+    offset += snprintf(
+        output_buffer + offset,
+        output_buffer_size - offset,
+        "[%s] ",
+        log->category
+    );
+
+    if (g_logger.show_thread)
+        offset += snprintf(
+            output_buffer + offset,
+            output_buffer_size - offset,
+            "[T:%u] ",
+            log->threadid
+        );
+
+    offset += snprintf(
+        output_buffer + offset,
+        output_buffer_size - offset,
+        "%s\n",
+        log->message
+    );
+
+    return ((size_t)offset < output_buffer_size) ? (size_t)offset
+                                                 : output_buffer_size - 1;
+}
+
+static void
+_dream_sink_stdout_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    dream_output_emit_line(
+        DREAM_LOG_OUT_STDOUT,
+        log->level,
+        log->line,
+        log->line_len,
+        g_logger.use_color
+    );
+}
+static void
+_dream_sink_stderr_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    dream_output_emit_line(
+        DREAM_LOG_OUT_STDERR,
+        log->level,
+        log->line,
+        log->line_len,
+        g_logger.use_color
+    );
+}
+static void
+_dream_sink_file_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    dream_output_emit_line(
+        DREAM_LOG_OUT_FILE, log->level, log->line, log->line_len, false
+    );
+}
+static void
+_dream_sink_ringbuff_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    dream_ring_buffer_push(log->line, log->line_len);
+}
+
+static uint32_t dream_binary_format_slot(const char *fmt, uint32_t capacity) {
+    uint64_t hash = ((uintptr_t)fmt >> 3) * 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(hash >> 32) & (capacity - 1);
+}
+
+static void dream_binary_free_formats(
+    const char **formats, uint32_t *ids, uint32_t capacity
+) {
+    _dream_free(DREAM_MEMORY_LOGGER, formats, capacity * sizeof(*formats));
+    _dream_free(DREAM_MEMORY_LOGGER, ids, capacity * sizeof(*ids));
+}
+
+// Returns the dictionary id of fmt, 0 if the dictionary cannot grow.
+static uint32_t dream_binary_format_id(const char *fmt, bool *is_new) {
+    DreamLogBinaryState *b = &g_logger.binary;
+    *is_new                = false;
+
+    if (2 * (b->format_count + 1) > b->format_capacity) {
+        uint32_t capacity = b->format_capacity ? 2 * b->format_capacity : 256;
+        const char **formats = _dream_calloc(
+            DREAM_MEMORY_LOGGER, capacity * sizeof(*formats), 0
+        );
+        uint32_t *ids =
+            _dream_alloc(DREAM_MEMORY_LOGGER, capacity * sizeof(*ids), 0);
+        if (!formats || !ids) {
+            dream_binary_free_formats(formats, ids, capacity);
+            return 0;
+        }
+        for (uint32_t i = 0; i < b->format_capacity; ++i) {
+            if (!b->formats[i]) continue;
+            uint32_t slot = dream_binary_format_slot(b->formats[i], capacity);
+            while (formats[slot]) slot = (slot + 1) & (capacity - 1);
+            formats[slot] = b->formats[i];
+            ids[slot]     = b->format_ids[i];
+        }
+        dream_binary_free_formats(
+            b->formats, b->format_ids, b->format_capacity
+        );
+        b->formats         = formats;
+        b->format_ids      = ids;
+        b->format_capacity = capacity;
+    }
+
+    uint32_t slot = dream_binary_format_slot(fmt, b->format_capacity);
+    while (b->formats[slot]) {
+        if (b->formats[slot] == fmt) return b->format_ids[slot];
+        slot = (slot + 1) & (b->format_capacity - 1);
+    }
+    b->formats[slot]    = fmt;
+    b->format_ids[slot] = ++b->format_count;
+    *is_new             = true;
+    return b->format_count;
+}
+
+// Appends a dictionary entry header: tag, id, length.
+static size_t
+dream_binary_def(uint8_t *out, DreamLogBinaryTag tag, uint64_t id, size_t len) {
+    size_t n = 0;
+    out[n++] = (uint8_t)tag;
+    n += _dream_log_put_varint(out + n, id);
+    n += _dream_log_put_varint(out + n, len);
+    return n;
+}
+
+static void
+_dream_sink_binary_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    DreamLogBinaryState *b = &g_logger.binary;
+    uint8_t category_def[1 + 2 * DREAM_LOG_BINARY_MAX_VARINT];
+    uint8_t format_def[1 + 2 * DREAM_LOG_BINARY_MAX_VARINT];
+    uint8_t record[2 + 5 * DREAM_LOG_BINARY_MAX_VARINT];
+    char text[DREAM_LOG_MAX_MESSAGE];
+    struct iovec parts[6];
+    int count = 0;
+
+    if (!g_logger.async_enabled) mtx_lock(&b->lock);
+
+    DreamLogCategoryId category = log->category_id;
+    uint64_t bit                = 1ull << (category % 64);
+    if (!(b->categories_defined[category / 64] & bit)) {
+        b->categories_defined[category / 64] |= bit;
+        size_t len = strlen(log->category);
+        parts[count++] = (struct iovec){
+            category_def,
+            dream_binary_def(
+                category_def, DREAM_LOG_BINARY_CATEGORY, category, len
+            ),
+        };
+        parts[count++] = (struct iovec){(void *)log->category, len};
+    }
+
+    uint32_t format     = 0;
+    const char *payload = log->message;
+    size_t payload_size;
+    if (log->fmt) {
+        bool is_new;
+        format = dream_binary_format_id(log->fmt, &is_new);
+        if (is_new) {
+            size_t len = strlen(log->fmt);
+            parts[count++] = (struct iovec){
+                format_def,
+                dream_binary_def(
+                    format_def, DREAM_LOG_BINARY_FORMAT, format, len
+                ),
+            };
+            parts[count++] = (struct iovec){(void *)log->fmt, len};
+        }
+    }
+    if (format) {
+        payload      = log->args;
+        payload_size = log->args_size;
+    } else {
+        if (!log->has_text) {
+            _dream_log_format_packed(
+                log->fmt, log->args, log->args_size, text, sizeof(text)
+            );
+            payload = text;
+        }
+        payload_size = strlen(payload);
+    }
+
+    uint64_t wall_ns = dream_log_wall_ns(log->timestamp);
+    int64_t delta    = (int64_t)(wall_ns - b->last_wall_ns);
+    b->last_wall_ns  = wall_ns;
+
+    size_t n    = 0;
+    record[n++] = DREAM_LOG_BINARY_RECORD;
+    record[n++] = (uint8_t)log->level;
+    n += _dream_log_put_varint(record + n, category);
+    n += _dream_log_put_varint(record + n, format);
+    n += _dream_log_put_varint(record + n, _dream_log_zigzag(delta));
+    n += _dream_log_put_varint(record + n, log->threadid);
+    n += _dream_log_put_varint(record + n, payload_size);
+    parts[count++] = (struct iovec){record, n};
+    parts[count++] = (struct iovec){(void *)payload, payload_size};
+
+    dream_output_emit(DREAM_LOG_OUT_BINARY, log->level, parts, count);
+
+    if (!g_logger.async_enabled) mtx_unlock(&b->lock);
+}
+
+static void
+_dream_sink_callback_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    g_logger.callback(
+        log->level,
+        log->category,
+        log->message,
+        log->line,
+        g_logger.callback_user_data
+    );
+}
+
+static void
+_dream_sink_shm_write(DreamLoggerSink *this, const DreamLogMsg *log) {
+    DreamLogShm *s = &g_logger.shm;
+    if (!g_logger.async_enabled) mtx_lock(&s->lock);
+    dream_shm_write(s, log);
+    if (!g_logger.async_enabled) mtx_unlock(&s->lock);
+}
+
+// Formats what the sink needs and is not there yet: nothing for the binary
+// sink, the message for the shared-memory one, the line for the rest.
+static void
+dream_dispatch_to(DreamLoggerSink *sink, DreamLogMsg *log, char *line) {
+    if (!log->line && sink->sink_into != DREAM_LOG_SINK_BINARY) {
+        if (!log->has_text) {
+            _dream_log_format_packed(
+                log->fmt,
+                log->args,
+                log->args_size,
+                log->message,
+                sizeof(log->message)
+            );
+            log->has_text = true;
+        }
+        if (sink->sink_into != DREAM_LOG_SINK_SHM) {
+            log->line_len =
+                __get_formatted_log(log, line, DREAM_LOG_MAX_LINE);
+            log->line = line;
+        }
+    }
+    sink->__write(sink, log);
+}
+
+// Hands a message to every interested sink, formatting its line once on the
+// first sink that needs it. Isolated sinks only get a copy in their backlog.
+static void dream_dispatch(DreamLogMsg *log) {
+    char line[DREAM_LOG_MAX_LINE];
+    log->line     = nullptr;
+    log->line_len = 0;
+
+    for (size_t i = 0; i < g_logger.sink_count; ++i) {
+        DreamLoggerSink *sink = g_logger.sinks[i];
+        if (!sink->__write || log->level < sink->min_level) continue;
+        if (sink->__worker)
+            dream_sink_worker_push(sink->__worker, log);
+        else
+            dream_dispatch_to(sink, log, line);
+    }
+}
+
+// Runs on the sink's own thread; the level was checked by dream_dispatch.
+static void dream_dispatch_isolated(DreamLoggerSink *sink, DreamLogMsg *log) {
+    char line[DREAM_LOG_MAX_LINE];
+    log->line     = nullptr;
+    log->line_len = 0;
+    dream_dispatch_to(sink, log, line);
+}
+
+static void dream_async_queue_destroy(DLMRingBuffer *q) {
+    _dream_free_pages(
+        DREAM_MEMORY_LOGGER, q->buffer, q->cell_count * DREAM_LOG_CELL_SIZE
+    );
+    _dream_free_pages(
+        DREAM_MEMORY_LOGGER, q->seq, sizeof(*q->seq) * q->cell_count
+    );
+    q->buffer = nullptr;
+    q->seq    = nullptr;
+}
+
+static bool dream_async_queue_init(DLMRingBuffer *q, size_t bytes) {
+    q->cell_count = DREAM_LOG_MIN_QUEUE_CELLS;
+    while (q->cell_count * DREAM_LOG_CELL_SIZE < bytes) q->cell_count <<= 1;
+
+    // Page-aligned, so also cell-aligned; large queues get huge pages.
+    q->buffer = _dream_alloc_pages(
+        DREAM_MEMORY_LOGGER, q->cell_count * DREAM_LOG_CELL_SIZE
+    );
+    q->seq = _dream_alloc_pages(
+        DREAM_MEMORY_LOGGER, sizeof(*q->seq) * q->cell_count
+    );
+    if (!q->buffer || !q->seq) {
+        dream_async_queue_destroy(q);
+        return false;
+    }
+
+    for (size_t i = 0; i < q->cell_count; ++i) atomic_init(&q->seq[i], i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->high_water, 0);
+    atomic_init(&q->enqueued, 0);
+    atomic_init(&q->dropped_newest, 0);
+    atomic_init(&q->dropped_oldest, 0);
+    atomic_init(&q->blocked, 0);
+    atomic_init(&q->blocked_ns, 0);
+    return true;
+}
+
+// Starts the thread of an isolated sink. If that fails the sink is simply
+// written by the worker like the others.
+static void dream_sink_worker_start(DreamLoggerSink *sink) {
+    DreamLogSinkWorker *w =
+        _dream_alloc(DREAM_MEMORY_LOGGER, sizeof(*w), DREAM_LOG_CELL_SIZE);
+    if (!w) return;
+    if (!dream_async_queue_init(
+            &w->backlog,
+            sink->backlog_bytes ? sink->backlog_bytes
+                                : DREAM_LOG_DEFAULT_SINK_BACKLOG_BYTES
+        )) {
+        _dream_free(DREAM_MEMORY_LOGGER, w, sizeof(*w));
+        return;
+    }
+
+    w->sink = sink;
+    switch (sink->sink_into) {
+        case DREAM_LOG_SINK_STDOUT:
+            w->out = &g_logger.out[DREAM_LOG_OUT_STDOUT];
+            break;
+        case DREAM_LOG_SINK_STDERR:
+            w->out = &g_logger.out[DREAM_LOG_OUT_STDERR];
+            break;
+        case DREAM_LOG_SINK_FILE:
+            w->out = &g_logger.out[DREAM_LOG_OUT_FILE];
+            break;
+        case DREAM_LOG_SINK_BINARY:
+            w->out = &g_logger.out[DREAM_LOG_OUT_BINARY];
+            break;
+        default:
+            w->out = nullptr;
+            break;
+    }
+    w->last_flush_ns = dream_monotonic_ns();
+    atomic_init(&w->running, true);
+    atomic_init(&w->state, DREAM_LOG_WORKER_RUNNING);
+    atomic_init(&w->written, 0);
+
+    if (w->out) w->out->isolated = true;
+    if (thrd_create(&w->thread, DreamSinkWorkerFn, w) != thrd_success) {
+        if (w->out) w->out->isolated = false;
+        dream_async_queue_destroy(&w->backlog);
+        _dream_free(DREAM_MEMORY_LOGGER, w, sizeof(*w));
+        return;
+    }
+    sink->__worker = w;
+}
+
+// Called once the worker has stopped pushing; the thread writes out the
+// rest of its backlog before it exits.
+static void dream_sink_worker_stop(DreamLoggerSink *sink) {
+    DreamLogSinkWorker *w = sink->__worker;
+    atomic_store_explicit(&w->running, false, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    dream_async_unpark(
+        &w->state, atomic_load_explicit(&w->state, memory_order_relaxed)
+    );
+    thrd_join(w->thread, nullptr);
+
+    if (w->out) w->out->isolated = false;
+    dream_async_queue_destroy(&w->backlog);
+    _dream_free(DREAM_MEMORY_LOGGER, w, sizeof(*w));
+    sink->__worker = nullptr;
+}
+
+static void dream_thread_queue_retire(void *tq) {
+    atomic_store_explicit(
+        &((DreamLogThreadQueue *)tq)->in_use, false, memory_order_release
+    );
+}
+
+// Returns the calling thread's private queue, adopting a retired one or
+// allocating a new one on first use. Falls back to the shared queue.
+static DLMRingBuffer *dream_async_queue_for_thread(void) {
+    if (!g_logger.async_per_thread_queues) return &g_logger.async_ringbuff;
+    if (t_thread_queue && t_thread_queue_generation == g_logger.generation)
+        return &t_thread_queue->ring;
+
+    DreamLogThreadQueue *tq = atomic_load_explicit(
+        &g_logger.thread_queues, memory_order_acquire
+    );
+    for (; tq; tq = tq->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong_explicit(
+                &tq->in_use,
+                &expected,
+                true,
+                memory_order_acquire,
+                memory_order_relaxed
+            ))
+            break;
+    }
+
+    if (!tq) {
+        tq = _dream_alloc(DREAM_MEMORY_LOGGER, sizeof(*tq), 0);
+        if (!tq) return &g_logger.async_ringbuff;
+        if (!dream_async_queue_init(
+                &tq->ring, g_logger.async_thread_queue_bytes
+            )) {
+            _dream_free(DREAM_MEMORY_LOGGER, tq, sizeof(*tq));
+            return &g_logger.async_ringbuff;
+        }
+        atomic_init(&tq->in_use, true);
+        tq->next = atomic_load_explicit(
+            &g_logger.thread_queues, memory_order_relaxed
+        );
+        while (!atomic_compare_exchange_weak_explicit(
+            &g_logger.thread_queues,
+            &tq->next,
+            tq,
+            memory_order_release,
+            memory_order_relaxed
+        )) {}
+    }
+
+    tss_set(g_logger.thread_queue_key, tq);
+    t_thread_queue            = tq;
+    t_thread_queue_generation = g_logger.generation;
+    return &tq->ring;
+}
+
+// Zones need better than the coarse clock's resolution.
+static inline uint64_t dream_profile_now(void) {
+#if defined(DREAM_HAS_TSC)
+    if (g_logger.clock == DREAM_LOG_CLOCK_TSC) return __rdtsc();
+#endif
+    return dream_clock_ns(CLOCK_MONOTONIC);
+}
+
+static void dream_profile_thread_retire(void *pt) {
+    atomic_store_explicit(
+        &((DreamProfileThread *)pt)->in_use, false, memory_order_release
+    );
+}
+
+// Returns the calling thread's zone buffer, adopting a retired one or
+// allocating a new one on first use; nullptr if out of memory.
+static DreamProfileThread *dream_profile_thread(void) {
+    DreamProfiler *p = &g_logger.profile;
+    if (t_profile_thread &&
+        t_profile_thread_generation == g_logger.generation)
+        return t_profile_thread;
+
+    DreamProfileThread *pt =
+        atomic_load_explicit(&p->threads, memory_order_acquire);
+    for (; pt; pt = pt->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong_explicit(
+                &pt->in_use,
+                &expected,
+                true,
+                memory_order_acquire,
+                memory_order_relaxed
+            ))
+            break;
+    }
+
+    if (!pt) {
+        pt = _dream_alloc(
+            DREAM_MEMORY_LOGGER, sizeof(*pt), DREAM_LOG_CELL_SIZE
+        );
+        if (!pt) return nullptr;
+        pt->events = _dream_alloc(
+            DREAM_MEMORY_LOGGER, p->thread_capacity * sizeof(*pt->events), 0
+        );
+        if (!pt->events) {
+            _dream_free(DREAM_MEMORY_LOGGER, pt, sizeof(*pt));
+            return nullptr;
+        }
+        pt->capacity  = p->thread_capacity;
+        pt->head_seen = 0;
+        atomic_init(&pt->head, 0);
+        atomic_init(&pt->tail, 0);
+        atomic_init(&pt->dropped, 0);
+        atomic_init(&pt->in_use, true);
+        pt->next = atomic_load_explicit(&p->threads, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(
+            &p->threads, &pt->next, pt, memory_order_release,
+            memory_order_relaxed
+        )) {
+        }
+    }
+
+    pt->threadid = dream_thread_id();
+    tss_set(p->thread_key, pt);
+    t_profile_thread            = pt;
+    t_profile_thread_generation = g_logger.generation;
+    return pt;
+}
+
+DreamZone DreamZoneBegin(const char *name) {
+    DreamZone zone = {nullptr, 0};
+    if (atomic_load_explicit(&g_dream_profile_on, memory_order_relaxed)) {
+        zone.name  = name;
+        zone.start = dream_profile_now();
+    }
+    return zone;
+}
+
+static void dream_profile_record(const DreamZone *zone, uint64_t end) {
+    DreamProfileThread *pt = dream_profile_thread();
+    if (!pt) return;
+
+    uint64_t tail = atomic_load_explicit(&pt->tail, memory_order_relaxed);
+    if (tail - pt->head_seen >= pt->capacity) {
+        pt->head_seen = atomic_load_explicit(&pt->head, memory_order_acquire);
+        if (tail - pt->head_seen >= pt->capacity) {
+            dream_stats_bump(&pt->dropped, 1);
+            return;
+        }
+    }
+    DreamProfileEvent *e = &pt->events[tail & (pt->capacity - 1)];
+    e->name              = zone->name;
+    e->start             = zone->start;
+    e->end               = end;
+    e->threadid          = pt->threadid;
+    atomic_store_explicit(&pt->tail, tail + 1, memory_order_release);
+}
+
+void DreamZoneEnd(DreamZone *zone) {
+    if (!zone->name ||
+        !atomic_load_explicit(&g_dream_profile_on, memory_order_relaxed))
+        return;
+    uint64_t end = dream_profile_now();
+
+    if (!t_profile_slot)
+        t_profile_slot = atomic_fetch_add_explicit(
+                             &g_dream_profile_next_slot, 1, memory_order_relaxed
+                         ) % DREAM_PROFILE_WRITER_SLOTS +
+                         1;
+    _Atomic uint32_t *writers =
+        &g_dream_profile_writers[t_profile_slot - 1].count;
+    // Announce first, then check again: shutdown clears the flag before it
+    // reads the slots, so either it waits for this call or the call sees
+    // profiling is off (both sides sequentially consistent).
+    atomic_fetch_add(writers, 1);
+    if (atomic_load(&g_dream_profile_on)) dream_profile_record(zone, end);
+    atomic_fetch_sub_explicit(writers, 1, memory_order_release);
+}
+
+static void dream_profile_put(DreamProfiler *p, const char *s, size_t n) {
+    if (p->used + n > DREAM_PROFILE_WRITE_BYTES) {
+        dream_fd_write_all(p->fd, p->out, p->used);
+        p->used = 0;
+    }
+    memcpy(p->out + p->used, s, n);
+    p->used += n;
+}
+
+// Writes `name` as the inside of a JSON string.
+static size_t dream_profile_escape(const char *name, char *out, size_t cap) {
+    static const char hex[] = "0123456789abcdef";
+    size_t n                = 0;
+    for (; *name && n + 6 < cap; ++name) {
+        unsigned char c = (unsigned char)*name;
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char)c;
+        } else if (c < 0x20) {
+            memcpy(out + n, "\\u00", 4);
+            out[n + 4] = hex[c >> 4];
+            out[n + 5] = hex[c & 15];
+            n += 6;
+        } else {
+            out[n++] = (char)c;
+        }
+    }
+    return n;
+}
+
+static void dream_profile_write_event(
+    DreamProfiler *p, const DreamProfileEvent *e
+) {
+    char name[256];
+    size_t name_len = dream_profile_escape(e->name, name, sizeof(name));
+    uint64_t start  = dream_log_wall_ns(e->start) - p->start_wall_ns;
+    uint64_t end    = dream_log_wall_ns(e->end) - p->start_wall_ns;
+    if (end < start) end = start;
+
+    char line[512];
+    int n = snprintf(
+        line,
+        sizeof(line),
+        "%s{\"name\":\"%.*s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,"
+        "\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+        p->any_events ? ",\n" : "",
+        (int)name_len,
+        name,
+        g_logger.pid,
+        e->threadid,
+        (unsigned long long)(start / 1000u),
+        (unsigned)(start % 1000u),
+        (unsigned long long)((end - start) / 1000u),
+        (unsigned)((end - start) % 1000u)
+    );
+    if (n > 0) dream_profile_put(p, line, (size_t)n);
+    p->any_events = true;
+}
+
+static void dream_profile_drain(DreamProfiler *p) {
+    for (DreamProfileThread *pt =
+             atomic_load_explicit(&p->threads, memory_order_acquire);
+         pt;
+         pt = pt->next) {
+        uint64_t head = atomic_load_explicit(&pt->head, memory_order_relaxed);
+        uint64_t tail = atomic_load_explicit(&pt->tail, memory_order_acquire);
+        for (; head != tail; ++head)
+            dream_profile_write_event(
+                p, &pt->events[head & (pt->capacity - 1)]
+            );
+        atomic_store_explicit(&pt->head, head, memory_order_release);
+    }
+    if (p->used) {
+        dream_fd_write_all(p->fd, p->out, p->used);
+        p->used = 0;
+    }
+}
+
+static int DreamProfilerFn(void *args) {
+    DreamLoggerInstallSignalStack();
+    DreamProfiler *p = &g_logger.profile;
+    for (;;) {
+        uint32_t wake = atomic_load_explicit(&p->wake, memory_order_acquire);
+        dream_profile_drain(p);
+        if (!atomic_load_explicit(&p->running, memory_order_acquire)) break;
+        dream_futex_wait(&p->wake, wake, p->flush_interval_ns);
+    }
+    dream_profile_drain(p);
+    return 0;
+}
+
+static bool dream_profile_init(const DreamLoggerConfig *config) {
+    DreamProfiler *p = &g_logger.profile;
+    p->fd            = -1;
+    if (!config->profile_path) return false;
+
+    size_t bytes = config->profile_thread_bytes
+        ? config->profile_thread_bytes
+        : DREAM_PROFILE_DEFAULT_THREAD_BYTES;
+    p->thread_capacity = 64;
+    while (p->thread_capacity * sizeof(DreamProfileEvent) < bytes)
+        p->thread_capacity <<= 1;
+    p->flush_interval_ns = (uint64_t)(config->profile_flush_ms
+                                          ? config->profile_flush_ms
+                                          : DREAM_PROFILE_DEFAULT_FLUSH_MS) *
+                           1000000u;
+    p->start_wall_ns = dream_log_wall_ns(dream_profile_now());
+    p->out = _dream_alloc(DREAM_MEMORY_LOGGER, DREAM_PROFILE_WRITE_BYTES, 0);
+    if (!p->out) return false;
+    if (tss_create(&p->thread_key, dream_profile_thread_retire) !=
+        thrd_success) {
+        _dream_free(DREAM_MEMORY_LOGGER, p->out, DREAM_PROFILE_WRITE_BYTES);
+        return false;
+    }
+    p->fd = open(
+        config->profile_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644
+    );
+    if (p->fd < 0) {
+        tss_delete(p->thread_key);
+        _dream_free(DREAM_MEMORY_LOGGER, p->out, DREAM_PROFILE_WRITE_BYTES);
+        return false;
+    }
+
+    static const char begin[] =
+        "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    dream_fd_write_all(p->fd, begin, sizeof(begin) - 1);
+    atomic_init(&p->threads, nullptr);
+    atomic_init(&p->wake, 0);
+    atomic_store_explicit(&p->running, true, memory_order_relaxed);
+    if (thrd_create(&p->thread, DreamProfilerFn, nullptr) != thrd_success) {
+        close(p->fd);
+        p->fd = -1;
+        tss_delete(p->thread_key);
+        _dream_free(DREAM_MEMORY_LOGGER, p->out, DREAM_PROFILE_WRITE_BYTES);
+        return false;
+    }
+    atomic_store_explicit(&g_dream_profile_on, true, memory_order_release);
+    return true;
+}
+
+// Zones that end after this starts are not recorded; one that is being
+// recorded on another thread is waited for and written out.
+static void dream_profile_shutdown(void) {
+    DreamProfiler *p = &g_logger.profile;
+    if (p->fd < 0) return;
+    atomic_store(&g_dream_profile_on, false);
+    for (size_t i = 0; i < DREAM_PROFILE_WRITER_SLOTS; ++i)
+        while (atomic_load(&g_dream_profile_writers[i].count)) thrd_yield();
+    atomic_store_explicit(&p->running, false, memory_order_release);
+    atomic_fetch_add_explicit(&p->wake, 1, memory_order_release);
+    dream_futex_wake(&p->wake);
+    thrd_join(p->thread, nullptr);
+
+    uint64_t dropped = 0;
+    DreamProfileThread *pt =
+        atomic_exchange_explicit(&p->threads, nullptr, memory_order_acquire);
+    while (pt) {
+        DreamProfileThread *next = pt->next;
+        dropped += atomic_load_explicit(&pt->dropped, memory_order_relaxed);
+        _dream_free(
+            DREAM_MEMORY_LOGGER,
+            pt->events,
+            pt->capacity * sizeof(*pt->events)
+        );
+        _dream_free(DREAM_MEMORY_LOGGER, pt, sizeof(*pt));
+        pt = next;
+    }
+    char end[96];
+    int n = snprintf(
+        end,
+        sizeof(end),
+        "\n],\"otherData\":{\"dropped_zones\":\"%llu\"}}\n",
+        (unsigned long long)dropped
+    );
+    dream_fd_write_all(p->fd, end, (size_t)n);
+    close(p->fd);
+    p->fd = -1;
+    tss_delete(p->thread_key);
+    _dream_free(DREAM_MEMORY_LOGGER, p->out, DREAM_PROFILE_WRITE_BYTES);
+    p->out = nullptr;
+}
+
+#if !defined(DREAM_PLATFORM_WIN32)
+// Crash handler (crash_handler). Everything it calls is async-signal-safe:
+// records are rendered with _dream_log_format_packed_raw into stack buffers
+// and written with write(). Other threads keep running, so the worker may
+// be draining at the same time; records are claimed lock-free, so each one
+// still comes out once.
+static const int g_dream_crash_signals[] = {
+    SIGSEGV, SIGBUS, SIGABRT, SIGFPE, SIGILL,
+};
+#define DREAM_CRASH_SIGNAL_COUNT \
+    (sizeof(g_dream_crash_signals) / sizeof(g_dream_crash_signals[0]))
+static struct sigaction g_dream_crash_previous[DREAM_CRASH_SIGNAL_COUNT];
+static atomic_bool g_dream_crash_installed;
+static atomic_flag g_dream_crash_entered = ATOMIC_FLAG_INIT;
+// The handler keeps a few KiB of buffers on its stack, which a stack
+// overflow has just used up, so it runs on a signal stack. Those are per
+// thread: DreamLoggerInstallSignalStack maps one for the calling thread and
+// the tss destructor unmaps it when the thread exits. The mapping bypasses
+// the user allocator because a thread can outlive DreamShutdown. Threads
+// with a signal stack of their own keep it.
+#define DREAM_CRASH_STACK_BYTES (64 * 1024)
+static tss_t g_dream_crash_stack_key;
+static bool g_dream_crash_stack_keyed;
+static once_flag g_dream_crash_stack_once = ONCE_FLAG_INIT;
+
+typedef struct DreamCrashLine {
+    char data[DREAM_LOG_MAX_LINE];
+    size_t len;
+} DreamCrashLine;
+
+static void dream_crash_put(DreamCrashLine *l, const char *s, size_t n) {
+    if (n > sizeof(l->data) - 1 - l->len) n = sizeof(l->data) - 1 - l->len;
+    memcpy(l->data + l->len, s, n);
+    l->len += n;
+}
+
+static void dream_crash_put_str(DreamCrashLine *l, const char *s) {
+    dream_crash_put(l, s, strlen(s));
+}
+
+// Decimal, zero padded to `width`.
+static void dream_crash_put_uint(DreamCrashLine *l, uint64_t v, int width) {
+    char buf[24];
+    int n = sizeof(buf);
+    do {
+        buf[--n] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v || (int)sizeof(buf) - n < width);
+    dream_crash_put(l, buf + n, sizeof(buf) - (size_t)n);
+}
+
+static void dream_crash_write_file(const char *s, size_t n) {
+    DreamLogMappedFile *m = &g_logger.mapped;
+    if (m->map) {
+        if (n > m->size - m->used) n = m->size - m->used;
+        memcpy(m->map + m->used, s, n);
+        m->used += n;
+        return;
+    }
+#if defined(DREAM_PLATFORM_LINUX)
+    if (g_logger.uring.fd >= 0) {
+        dream_fd_pwrite_all(
+            g_logger.uring.file_fd, s, n, (off_t)g_logger.uring.offset
+        );
+        g_logger.uring.offset += n;
+        return;
+    }
+#endif
+    if (g_logger.logfile_fd >= 0) dream_fd_write_all(g_logger.logfile_fd, s, n);
+}
+
+static void dream_crash_write(const char *s, size_t n) {
+    dream_fd_write_all(STDERR_FILENO, s, n);
+    dream_crash_write_file(s, n);
+}
+
+// Output the worker had buffered but not written yet.
+static void dream_crash_write_buffers(void) {
+    for (int i = 0; i < DREAM_LOG_OUT_COUNT; ++i) {
+        DreamLogWriteBuffer *b = &g_logger.out[i];
+        if (!b->data || !b->used) continue;
+        if (i == DREAM_LOG_OUT_FILE)
+            dream_crash_write_file(b->data, b->used);
+        else if (b->fd >= 0)
+            dream_fd_write_all(b->fd, b->data, b->used);
+        b->used = 0;
+    }
+}
+
+static void dream_crash_drain(DLMRingBuffer *q) {
+    size_t pos;
+    uint32_t cells;
+    char payload[DREAM_LOG_MAX_MESSAGE];
+    char message[DREAM_LOG_MAX_MESSAGE];
+
+    while (dream_async_claim_head(q, &pos, &cells)) {
+        const DreamLogRecord *rec = dream_async_record_at(q, pos);
+        DreamCrashLine line       = {.len = 0};
+        uint32_t payload_size     = rec->payload_size;
+        dream_async_payload_read(q, pos, payload, payload_size);
+
+        if (g_logger.show_time) {
+            uint64_t wall = dream_log_wall_ns(atomic_load_explicit(
+                &rec->timestamp, memory_order_relaxed
+            ));
+            int64_t sec = (int64_t)(wall / 1000000000u) + g_logger.utc_offset_s;
+            uint64_t day = (uint64_t)(sec % 86400 + 86400) % 86400;
+            dream_crash_put_str(&line, "[");
+            dream_crash_put_uint(&line, day / 3600, 2);
+            dream_crash_put_str(&line, ":");
+            dream_crash_put_uint(&line, day / 60 % 60, 2);
+            dream_crash_put_str(&line, ":");
+            dream_crash_put_uint(&line, day % 60, 2);
+            dream_crash_put_str(&line, ".");
+            dream_crash_put_uint(&line, wall / 1000000u % 1000u, 3);
+            dream_crash_put_str(&line, "] ");
+        }
+        dream_crash_put_str(&line, "[");
+        dream_crash_put_str(&line, dream_log_level_string(rec->level));
+        dream_crash_put_str(&line, "] [");
+        dream_crash_put_str(&line, dream_log_category_name(rec->category));
+        dream_crash_put_str(&line, "] ");
+        if (g_logger.show_thread) {
+            dream_crash_put_str(&line, "[T:");
+            dream_crash_put_uint(&line, rec->threadid, 0);
+            dream_crash_put_str(&line, "] ");
+        }
+        if (rec->fmt) {
+            size_t n = _dream_log_format_packed_raw(
+                rec->fmt, payload, payload_size, message, sizeof(message)
+            );
+            dream_crash_put(&line, message, n);
+        } else {
+            dream_crash_put(&line, payload, strnlen(payload, payload_size));
+        }
+        dream_async_release(q, pos, cells);
+
+        if (line.len == sizeof(line.data) - 1) --line.len;
+        line.data[line.len++] = '\n';
+        dream_crash_write(line.data, line.len);
+    }
+}
+
+static void dream_crash_dump_ring(void) {
+    DreamLogFlightHeader *header = g_logger.ring.header;
+    if (!header) return;
+    uint64_t next = atomic_load_explicit(&header->next, memory_order_acquire);
+    uint64_t seq  = next > header->slot_count ? next - header->slot_count : 0;
+    size_t cap    = header->slot_size - sizeof(DreamLogFlightSlot);
+    static const char begin[] = "---- Dream Ring Buffer Dump ----\n";
+    dream_crash_write(begin, sizeof(begin) - 1);
+    for (; seq < next; ++seq) {
+        DreamLogFlightSlot *slot = _dream_log_flight_slot(header, seq);
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+            2 * seq + 2)
+            continue;
+        dream_crash_write(slot->text, slot->len < cap ? slot->len : cap);
+    }
+}
+
+static void dream_crash_handler(int sig) {
+    int saved_errno = errno;
+    if (!atomic_flag_test_and_set(&g_dream_crash_entered)) {
+        DreamCrashLine line = {.len = 0};
+        dream_crash_put_str(&line, "---- Dream crash: signal ");
+        dream_crash_put_uint(&line, (uint64_t)sig, 0);
+        dream_crash_put_str(&line, ", writing out queued records ----\n");
+        dream_crash_write_buffers();
+        dream_crash_write(line.data, line.len);
+        if (g_logger.async_enabled) {
+            dream_crash_drain(&g_logger.async_ringbuff);
+            for (DreamLogThreadQueue *tq = atomic_load_explicit(
+                     &g_logger.thread_queues, memory_order_acquire
+                 );
+                 tq;
+                 tq = tq->next)
+                dream_crash_drain(&tq->ring);
+            // Backlogs of isolated sinks writing where this dump goes.
+            for (size_t i = 0; i < g_logger.sink_count; ++i) {
+                DreamLogSinkWorker *w = g_logger.sinks[i]->__worker;
+                if (w && (w->sink->sink_into == DREAM_LOG_SINK_FILE ||
+                          w->sink->sink_into == DREAM_LOG_SINK_STDERR))
+                    dream_crash_drain(&w->backlog);
+            }
+            // Whatever the worker drained alongside us.
+            dream_crash_write_buffers();
+        }
+        dream_crash_dump_ring();
+    }
+
+    // Hand the signal to whoever had it before; for SIG_DFL that means the
+    // usual core dump once this handler returns.
+    for (size_t i = 0; i < DREAM_CRASH_SIGNAL_COUNT; ++i)
+        if (g_dream_crash_signals[i] == sig)
+            sigaction(sig, &g_dream_crash_previous[i], nullptr);
+    errno = saved_errno;
+    raise(sig);
+}
+
+static void dream_crash_stack_retire(void *stack) {
+    stack_t current;
+    if (sigaltstack(nullptr, &current) == 0 && current.ss_sp == stack) {
+        stack_t off = {.ss_flags = SS_DISABLE};
+        sigaltstack(&off, nullptr);
+    }
+    munmap(stack, DREAM_CRASH_STACK_BYTES);
+}
+
+static void dream_crash_stack_key_init(void) {
+    g_dream_crash_stack_keyed =
+        tss_create(&g_dream_crash_stack_key, dream_crash_stack_retire) ==
+        thrd_success;
+}
+
+void DreamLoggerInstallSignalStack(void) {
+    if (!atomic_load_explicit(&g_dream_crash_installed, memory_order_acquire))
+        return;
+    call_once(&g_dream_crash_stack_once, dream_crash_stack_key_init);
+
+    stack_t current;
+    if (sigaltstack(nullptr, &current) != 0 ||
+        !(current.ss_flags & SS_DISABLE))
+        return;
+    void *stack = mmap(
+        nullptr,
+        DREAM_CRASH_STACK_BYTES,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (stack == MAP_FAILED) return;
+    stack_t alt = {.ss_sp = stack, .ss_size = DREAM_CRASH_STACK_BYTES};
+    if (sigaltstack(&alt, nullptr) != 0) {
+        munmap(stack, DREAM_CRASH_STACK_BYTES);
+        return;
+    }
+    // Without the key the stack stays mapped until the process ends.
+    if (g_dream_crash_stack_keyed)
+        tss_set(g_dream_crash_stack_key, stack);
+}
+
+static void dream_crash_install(void) {
+    if (atomic_load_explicit(&g_dream_crash_installed, memory_order_relaxed))
+        return;
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    g_logger.utc_offset_s = tm.tm_gmtoff;
+
+    struct sigaction action = {
+        .sa_handler = dream_crash_handler,
+        .sa_flags   = SA_ONSTACK,
+    };
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < DREAM_CRASH_SIGNAL_COUNT; ++i)
+        sigaction(
+            g_dream_crash_signals[i], &action, &g_dream_crash_previous[i]
+        );
+    atomic_store_explicit(&g_dream_crash_installed, true, memory_order_release);
+    DreamLoggerInstallSignalStack();
+}
+
+static void dream_crash_uninstall(void) {
+    if (!atomic_load_explicit(&g_dream_crash_installed, memory_order_relaxed))
+        return;
+    for (size_t i = 0; i < DREAM_CRASH_SIGNAL_COUNT; ++i)
+        sigaction(
+            g_dream_crash_signals[i], &g_dream_crash_previous[i], nullptr
+        );
+    atomic_store_explicit(
+        &g_dream_crash_installed, false, memory_order_relaxed
+    );
+}
+#else
+void DreamLoggerInstallSignalStack(void) {}
+#endif
+
+void DreamLoggerInit(const DreamLoggerConfig *config) {
+    uint32_t generation = g_logger.generation;
+    memset(&g_logger, 0, sizeof(g_logger));
+    g_logger.generation = generation + 1;
+
+    g_logger.enabled                           = config->enabled;
+    g_logger.use_color                         = config->use_color;
+    g_logger.use_emoji                         = config->use_emoji;
+    g_logger.show_time                         = config->show_time;
+    g_logger.show_thread                       = config->show_thread;
+    g_logger.global_min_log_level              = config->global_min_log_level;
+    g_logger.initialized                       = true;
+    g_logger.ring.initialized                  = false;
+    g_logger.ring.dump_after_async_thread_join = false;
+
+    if (config->rate_limit_per_sec) {
+        uint32_t burst = config->rate_limit_burst ? config->rate_limit_burst
+                                                  : config->rate_limit_per_sec;
+        g_logger.rate_interval_ns = 1000000000u / config->rate_limit_per_sec;
+        if (!g_logger.rate_interval_ns) g_logger.rate_interval_ns = 1;
+        g_logger.rate_burst_ns = g_logger.rate_interval_ns * (burst - 1);
+    }
+    g_logger.collapse_repeats = config->collapse_repeats;
+    g_logger.collapse_window_ns =
+        (uint64_t)(config->collapse_window_ms ? config->collapse_window_ms
+                                              : 1000) *
+        1000000u;
+
+    // Every category restarts from the global level.
+    for (size_t i = 0; i < DREAM_LOG_MAX_CATEGORIES; ++i) {
+        atomic_store_explicit(
+            &g_dream_log_category_levels[i],
+            (uint8_t)config->global_min_log_level,
+            memory_order_relaxed
+        );
+    }
+    for (uint16_t i = 0; i < config->category_level_count; ++i) {
+        DreamLogSetCategoryLevel(
+            config->category_levels[i].category,
+            config->category_levels[i].min_level
+        );
+    }
+
+    // Chosen and calibrated before any thread of ours starts, so the
+    // worker, the profiler and the sink threads only ever read the clock
+    // state.
+    dream_clock_init(
+        config->clock == DREAM_LOG_CLOCK_TSC && !config->async
+            ? DREAM_LOG_CLOCK_MONOTONIC
+            : config->clock
+    );
+    dream_tsc_calibrate();
+
+#ifdef DREAM_PLATFORM_WIN32
+    g_logger.console = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    GetConsoleScreenBufferInfo(g_logger.console, &info);
+    g_logger.default_attributes = info.wAttributes;
+#endif
+
+    g_logger.pid        = (uint32_t)getpid();
+    g_logger.logfile_fd = -1;
+    for (int i = 0; i < DREAM_LOG_OUT_COUNT; ++i) g_logger.out[i].fd = -1;
+#if defined(DREAM_PLATFORM_LINUX)
+    g_logger.uring.fd = -1;
+#endif
+
+    g_logger.sinks      = config->sinks;
+    g_logger.sink_count = config->sink_count;
+
+    for (size_t i = 0; i < g_logger.sink_count; ++i) {
+        DreamLoggerSink *sink = g_logger.sinks[i];
+        sink->__worker        = nullptr;
+        switch (sink->sink_into) {
+            case DREAM_LOG_SINK_STDOUT: {
+                g_logger.out[DREAM_LOG_OUT_STDOUT].fd = STDOUT_FILENO;
+                sink->__write = _dream_sink_stdout_write;
+                break;
+            }
+            case DREAM_LOG_SINK_STDERR: {
+                g_logger.out[DREAM_LOG_OUT_STDERR].fd = STDERR_FILENO;
                 sink->__write = _dream_sink_stderr_write;
                 break;
             }
             case DREAM_LOG_SINK_FILE: {
-                g_logger.logfile = fopen(config->logfile_path, "w");
-                if (g_logger.logfile)
+                if (config->logfile_segment_bytes) {
+                    if (dream_mapped_init(config))
+                        sink->__write = _dream_sink_file_write;
+                    else
+                        sink->__write = nullptr;
+                    break;
+                }
+                g_logger.logfile_fd = open(
+                    config->logfile_path,
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644
+                );
+                g_logger.out[DREAM_LOG_OUT_FILE].fd = g_logger.logfile_fd;
+                if (g_logger.logfile_fd >= 0)
                     sink->__write = _dream_sink_file_write;
                 else
                     sink->__write = nullptr;
                 break;
             }
             case DREAM_LOG_SINK_RING_BUFFER: {
-                uint32_t total_size =
-                    config->ring_buffer_lines * config->ring_buffer_line_len;
-                g_logger.ring.buffer = malloc(total_size);
-                if (g_logger.ring.buffer) {
-                    memset(g_logger.ring.buffer, 0, total_size);
-                    g_logger.ring.capacity    = config->ring_buffer_lines;
-                    g_logger.ring.line_len    = config->ring_buffer_line_len;
-                    g_logger.ring.head        = 0;
-                    g_logger.ring.count       = 0;
-                    g_logger.ring.initialized = true;
-                    sink->__write             = _dream_sink_ringbuff_write;
+                if (dream_ring_buffer_init(config))
+                    sink->__write = _dream_sink_ringbuff_write;
+                else
+                    sink->__write = nullptr;
+                break;
+            }
+            case DREAM_LOG_SINK_BINARY: {
+                int fd = open(
+                    config->binary_logfile_path,
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644
+                );
+                if (fd >= 0) {
+                    DreamLogBinaryHeader header = _dream_log_binary_header();
+                    dream_fd_write_all(
+                        fd, (const char *)&header, sizeof(header)
+                    );
+                    mtx_init(&g_logger.binary.lock, mtx_plain);
+                    sink->__write = _dream_sink_binary_write;
                 } else {
-                    g_logger.ring.buffer      = nullptr;
-                    g_logger.ring.initialized = false;
-                    sink->__write             = nullptr;
+                    sink->__write = nullptr;
                 }
+                g_logger.out[DREAM_LOG_OUT_BINARY].fd = fd;
+                break;
+            }
+            case DREAM_LOG_SINK_SHM: {
+                if (dream_shm_init(config))
+                    sink->__write = _dream_sink_shm_write;
+                else
+                    sink->__write = nullptr;
                 break;
             }
             case DREAM_LOG_SINK_CALLBACK: {
@@ -465,73 +3228,445 @@ void DreamLoggerInit(const DreamLoggerConfig *config) {
         }
     }
 
+#if !defined(DREAM_PLATFORM_WIN32)
+    if (config->crash_handler) dream_crash_install();
+#endif
+#if !defined(DREAM_PLATFORM_LINUX)
+    // The worker, isolated sinks and the profiler all sleep on these.
+    mtx_init(&g_logger.sleep_mutex, mtx_plain);
+    cnd_init(&g_logger.sleep_cond);
+#endif
+    dream_profile_init(config);
+
     g_logger.async_enabled = false;
     if (config->async) {
+        size_t bytes = config->async_queue_bytes;
+        if (bytes == 0)
+            bytes = config->async_queue_capacity * DREAM_LOG_AVG_RECORD_CELLS *
+                    DREAM_LOG_CELL_SIZE;
+        if (!dream_async_queue_init(&g_logger.async_ringbuff, bytes))
+            return; // stay synchronous
+
+        g_logger.async_drain_order = config->async_drain_order;
+
+        atomic_init(&g_logger.thread_queues, nullptr);
+        if (config->async_per_thread_queues &&
+            tss_create(&g_logger.thread_queue_key, dream_thread_queue_retire) ==
+                thrd_success) {
+            g_logger.async_per_thread_queues  = true;
+            g_logger.async_thread_queue_bytes = config->async_thread_queue_bytes
+                ? config->async_thread_queue_bytes
+                : DREAM_LOG_DEFAULT_THREAD_QUEUE_BYTES;
+        }
+
         g_logger.async_enabled             = true;
+        g_logger.async_deferred_format     = config->async_deferred_format;
         g_logger.async_log_overflow_policy = config->async_log_overflow_policy;
-        g_logger.async_queue_capacity      = config->async_queue_capacity;
-        g_logger.async_ringbuff.buffer =
-            malloc(sizeof(DLMRingBuffer) * g_logger.async_queue_capacity);
-        atomic_init(&g_logger.async_ringbuff.head, 0);
-        atomic_init(&g_logger.async_ringbuff.tail, 0);
-        mtx_init(&g_logger.sleep_mutex, mtx_plain);
-        cnd_init(&g_logger.sleep_cond);
+        g_logger.async_spin_count = config->async_spin_count
+            ? config->async_spin_count
+            : DREAM_LOG_DEFAULT_SPIN_COUNT;
+        g_logger.async_wake_fill_percent = config->async_wake_fill_percent
+            ? config->async_wake_fill_percent
+            : DREAM_LOG_DEFAULT_WAKE_FILL_PERCENT;
+        g_logger.async_wake_latency_ns =
+            (uint64_t)(config->async_wake_latency_us
+                           ? config->async_wake_latency_us
+                           : DREAM_LOG_DEFAULT_WAKE_LATENCY_US) *
+            1000u;
+        atomic_init(&g_logger.worker_state, DREAM_LOG_WORKER_RUNNING);
+
+        g_logger.flush_level = config->async_flush_level_set
+            ? config->async_flush_level
+            : DREAM_LOG_DEFAULT_FLUSH_LEVEL;
+        g_logger.flush_interval_ns =
+            (uint64_t)(config->async_flush_interval_ms
+                           ? config->async_flush_interval_ms
+                           : DREAM_LOG_DEFAULT_FLUSH_INTERVAL_MS) *
+            1000000u;
+        g_logger.last_flush_ns = dream_monotonic_ns();
+        size_t sink_buffer_bytes = config->sink_buffer_bytes
+            ? config->sink_buffer_bytes
+            : DREAM_LOG_DEFAULT_SINK_BUFFER_BYTES;
+        for (int i = 0; i < DREAM_LOG_OUT_COUNT; ++i) {
+            DreamLogWriteBuffer *b = &g_logger.out[i];
+            if (b->fd < 0) continue;
+            // Unbuffered if this fails.
+            b->data = _dream_alloc(DREAM_MEMORY_LOGGER, sink_buffer_bytes, 0);
+            b->capacity = b->data ? sink_buffer_bytes : 0;
+            b->used     = 0;
+        }
+#if defined(DREAM_PLATFORM_LINUX)
+        // Buffers sized for at least one whole line, so nothing bypasses
+        // them with a write() at the file position.
+        DreamLogWriteBuffer *file = &g_logger.out[DREAM_LOG_OUT_FILE];
+        size_t uring_bytes        = sink_buffer_bytes;
+        if (uring_bytes < 2 * DREAM_LOG_MAX_LINE)
+            uring_bytes = 2 * DREAM_LOG_MAX_LINE;
+        if (config->async_file_uring && file->fd >= 0 &&
+            dream_uring_init(
+                &g_logger.uring,
+                file->fd,
+                config->async_file_uring_buffers
+                    ? config->async_file_uring_buffers
+                    : DREAM_LOG_DEFAULT_URING_BUFFERS,
+                uring_bytes
+            )) {
+            _dream_free(DREAM_MEMORY_LOGGER, file->data, file->capacity);
+            file->data     = g_logger.uring.buffers[0].data;
+            file->capacity = uring_bytes;
+            file->used     = 0;
+        }
+#endif
+        for (size_t i = 0; i < g_logger.sink_count; ++i) {
+            DreamLoggerSink *sink = g_logger.sinks[i];
+            if (sink->isolated && sink->__write) dream_sink_worker_start(sink);
+        }
         atomic_store(&g_logger.async_thread_running, true);
         thrd_create(&g_logger.async_worker, DreamAsyncWorkerFn, nullptr);
     }
 }
 
 void DreamLoggerShutdown(void) {
+#if !defined(DREAM_PLATFORM_WIN32)
+    dream_crash_uninstall();
+#endif
+    if (g_logger.initialized) dream_log_sites_report(false);
     if (g_logger.async_enabled) {
         atomic_store_explicit(
             &g_logger.async_thread_running, false, memory_order_release
         );
-        mtx_lock(&g_logger.sleep_mutex);
-        cnd_signal(&g_logger.sleep_cond);
-        mtx_unlock(&g_logger.sleep_mutex);
+        dream_async_wake_worker();
         thrd_join(g_logger.async_worker, nullptr);
+        for (size_t i = 0; i < g_logger.sink_count; ++i)
+            if (g_logger.sinks[i]->__worker)
+                dream_sink_worker_stop(g_logger.sinks[i]);
+        dream_async_queue_destroy(&g_logger.async_ringbuff);
+        if (g_logger.async_per_thread_queues) {
+            tss_delete(g_logger.thread_queue_key);
+            DreamLogThreadQueue *tq = atomic_exchange_explicit(
+                &g_logger.thread_queues, nullptr, memory_order_acquire
+            );
+            while (tq) {
+                DreamLogThreadQueue *next = tq->next;
+                dream_async_queue_destroy(&tq->ring);
+                _dream_free(DREAM_MEMORY_LOGGER, tq, sizeof(*tq));
+                tq = next;
+            }
+            g_logger.async_per_thread_queues = false;
+        }
+    }
+    if (g_logger.out[DREAM_LOG_OUT_BINARY].fd >= 0) {
+        close(g_logger.out[DREAM_LOG_OUT_BINARY].fd);
+        mtx_destroy(&g_logger.binary.lock);
+        dream_binary_free_formats(
+            g_logger.binary.formats,
+            g_logger.binary.format_ids,
+            g_logger.binary.format_capacity
+        );
+    }
+#if defined(DREAM_PLATFORM_LINUX)
+    if (g_logger.uring.fd >= 0) {
+        dream_output_flush(&g_logger.out[DREAM_LOG_OUT_FILE]);
+        g_logger.out[DREAM_LOG_OUT_FILE].data = nullptr; // owned by the ring
+        dream_uring_shutdown(&g_logger.uring);
+    }
+#endif
+    for (int i = 0; i < DREAM_LOG_OUT_COUNT; ++i) {
+        _dream_free(
+            DREAM_MEMORY_LOGGER, g_logger.out[i].data, g_logger.out[i].capacity
+        );
+        g_logger.out[i].data = nullptr;
+        g_logger.out[i].fd   = -1;
+    }
+    if (g_logger.logfile_fd >= 0) {
+        close(g_logger.logfile_fd);
+        g_logger.logfile_fd = -1;
+    }
+    dream_mapped_shutdown();
+    dream_shm_shutdown();
+    dream_profile_shutdown();
+#if !defined(DREAM_PLATFORM_LINUX)
+    if (g_logger.initialized) {
         cnd_destroy(&g_logger.sleep_cond);
         mtx_destroy(&g_logger.sleep_mutex);
-        free(g_logger.async_ringbuff.buffer);
-        g_logger.async_ringbuff.buffer = nullptr;
     }
-    if (g_logger.logfile) {
-        fclose(g_logger.logfile);
-        g_logger.logfile = nullptr;
-    }
-    if (g_logger.ring.initialized && g_logger.ring.buffer) {
+#endif
+    if (g_logger.ring.initialized) {
         if (g_logger.ring.dump_after_async_thread_join)
             DreamLoggerDumpRingBuffer(stderr);
-        free(g_logger.ring.buffer);
-        g_logger.ring.buffer      = nullptr;
-        g_logger.ring.initialized = false;
+        dream_ring_buffer_shutdown();
     }
     g_logger.initialized = false;
 }
 
-void DreamLog(DreamLogLevel level, const char *category, const char *fmt, ...) {
-    if (!g_logger.initialized || !g_logger.enabled) return;
-    if (level < g_logger.global_min_log_level) return;
+DreamLogCategoryId DreamLogCategory(const char *name) {
+    if (!name) name = "";
+    uint32_t hash         = dream_log_category_hash(name);
+    DreamLogCategoryId id = dream_log_category_find(name, hash);
+    if (id) return id;
+
+    call_once(&g_log_categories_once, dream_log_categories_init);
+    mtx_lock(&g_log_categories.lock);
+    id = dream_log_category_find(name, hash);
+    if (!id && g_log_categories.count < DREAM_LOG_MAX_CATEGORIES) {
+        id = (DreamLogCategoryId)g_log_categories.count++;
+        snprintf(
+            g_log_categories.names[id], DREAM_LOG_CATEGORY_NAME_LEN, "%s", name
+        );
+        atomic_store_explicit(
+            &g_dream_log_category_levels[id],
+            (uint8_t)g_logger.global_min_log_level,
+            memory_order_relaxed
+        );
+        uint32_t slot = hash % DREAM_LOG_CATEGORY_SLOTS;
+        while (atomic_load_explicit(
+            &g_log_categories.slots[slot], memory_order_relaxed
+        ))
+            slot = (slot + 1) % DREAM_LOG_CATEGORY_SLOTS;
+        atomic_store_explicit(
+            &g_log_categories.slots[slot], id, memory_order_release
+        );
+    }
+    mtx_unlock(&g_log_categories.lock);
+    return id;
+}
 
-    DreamLogMsg log;
-    log.level     = level;
-    log.threadid  = dream_thread_id();
-    log.pid       = 0; // do later
-    log.timestamp = 0; // do later
-    snprintf(log.category, sizeof(log.category), "%s", category);
+void DreamLogSetCategoryLevel(const char *category, DreamLogLevel level) {
+    atomic_store_explicit(
+        &g_dream_log_category_levels[DreamLogCategory(category)],
+        (uint8_t)level,
+        memory_order_relaxed
+    );
+}
+
+DreamLogLevel DreamLogGetCategoryLevel(const char *category) {
+    return (DreamLogLevel)atomic_load_explicit(
+        &g_dream_log_category_levels[DreamLogCategory(category)],
+        memory_order_relaxed
+    );
+}
+
+static void dream_log_v(
+    DreamLogLevel level,
+    DreamLogCategoryId category,
+    DreamLogSite *site,
+    const char *fmt,
+    va_list args
+);
+
+// Logs a line on behalf of the logger. direct is for the worker: it is the
+// consumer, so it dispatches the line itself instead of queueing it.
+static void dream_log_note(
+    bool direct,
+    DreamLogLevel level,
+    DreamLogCategoryId category,
+    const char *fmt,
+    ...
+) {
     va_list args;
     va_start(args, fmt);
-    vsnprintf(log.message, sizeof(log.message), fmt, args);
+    if (direct) {
+        DreamLogMsg log = {
+            .level       = level,
+            .timestamp   = dream_log_now(),
+            .threadid    = dream_thread_id(),
+            .pid         = g_logger.pid,
+            .category_id = category,
+            .category    = dream_log_category_name(category),
+            .has_text    = true,
+        };
+        vsnprintf(log.message, sizeof(log.message), fmt, args);
+        dream_dispatch(&log);
+    } else {
+        dream_log_v(level, category, nullptr, fmt, args);
+    }
     va_end(args);
+}
+
+// Sites that dropped lines; never reset, like the category table.
+static _Atomic(DreamLogSite *) g_log_sites;
+
+static void dream_log_site_track(DreamLogSite *site, DreamLogLevel level) {
+    if (atomic_exchange_explicit(&site->tracked, true, memory_order_relaxed))
+        return;
+    site->level = (uint8_t)level;
+    site->next  = atomic_load_explicit(&g_log_sites, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &g_log_sites,
+        &site->next,
+        site,
+        memory_order_release,
+        memory_order_relaxed
+    )) {}
+}
+
+// Logs what the site dropped since its last line.
+static void dream_log_site_report(DreamLogSite *site, bool direct) {
+    DreamLogLevel level = (DreamLogLevel)site->level;
+    DreamLogCategoryId category = (DreamLogCategoryId)(
+        atomic_load_explicit(&site->category, memory_order_relaxed) - 1
+    );
+
+    // Plain loads first: most lines have nothing to report, and exchanging
+    // would take the site's line exclusive on every one of them.
+    uint32_t repeats =
+        atomic_load_explicit(&site->repeats, memory_order_relaxed);
+    if (repeats)
+        repeats =
+            atomic_exchange_explicit(&site->repeats, 0, memory_order_relaxed);
+    if (repeats)
+        dream_log_note(
+            direct,
+            level,
+            category,
+            "last message repeated %u times",
+            repeats
+        );
+    uint32_t suppressed =
+        atomic_load_explicit(&site->suppressed, memory_order_relaxed);
+    if (suppressed)
+        suppressed = atomic_exchange_explicit(
+            &site->suppressed, 0, memory_order_relaxed
+        );
+    if (suppressed)
+        dream_log_note(
+            direct,
+            level,
+            category,
+            "%u messages suppressed by rate limit",
+            suppressed
+        );
+}
+
+static void dream_log_sites_report(bool direct) {
+    for (DreamLogSite *site =
+             atomic_load_explicit(&g_log_sites, memory_order_acquire);
+         site;
+         site = site->next) {
+        dream_log_site_report(site, direct);
+    }
+}
+
+// Generic cell rate algorithm: a token bucket kept in a single word. Each
+// line moves the site's theoretical arrival time one interval on; a line
+// is refused while that time runs more than the burst ahead of now.
+static bool dream_log_rate_allow(DreamLogSite *site, uint64_t now_ns) {
+    uint64_t tat = atomic_load_explicit(&site->rate_tat, memory_order_relaxed);
+    for (;;) {
+        uint64_t start = tat > now_ns ? tat : now_ns;
+        if (start - now_ns > g_logger.rate_burst_ns) return false;
+        if (atomic_compare_exchange_weak_explicit(
+                &site->rate_tat,
+                &tat,
+                start + g_logger.rate_interval_ns,
+                memory_order_relaxed,
+                memory_order_relaxed
+            ))
+            return true;
+    }
+}
+
+// FNV-1a over the format and its packed arguments, or the formatted text.
+static uint64_t dream_log_msg_hash(const DreamLogMsg *log) {
+    const char *data = log->fmt ? log->args : log->message;
+    size_t n         = log->fmt ? log->args_size : strlen(log->message);
+    uint64_t hash = 14695981039346656037ull ^ (uint64_t)(uintptr_t)log->fmt;
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash | 1; // 0 means the site has not logged yet
+}
+
+// Collapses a line that repeats the site's previous one, otherwise reports
+// what the site dropped before it. Concurrent callers on one site can race
+// on the window bookkeeping, but every dropped line is counted once.
+static bool dream_log_site_admit(
+    DreamLogSite *site, const DreamLogMsg *log, uint64_t now_ns
+) {
+    if (g_logger.collapse_repeats) {
+        uint64_t hash = dream_log_msg_hash(log);
+        uint64_t last_hash =
+            atomic_load_explicit(&site->last_hash, memory_order_relaxed);
+        uint64_t last_ns =
+            atomic_load_explicit(&site->last_ns, memory_order_relaxed);
+        if (hash == last_hash &&
+            now_ns - last_ns < g_logger.collapse_window_ns) {
+            if (!atomic_fetch_add_explicit(
+                    &site->repeats, 1, memory_order_relaxed
+                ))
+                dream_log_site_track(site, log->level);
+            return false;
+        }
+        atomic_store_explicit(&site->last_hash, hash, memory_order_relaxed);
+        atomic_store_explicit(&site->last_ns, now_ns, memory_order_relaxed);
+    }
+
+    dream_log_site_report(site, false);
+    return true;
+}
+
+static void dream_log_v(
+    DreamLogLevel level,
+    DreamLogCategoryId category,
+    DreamLogSite *site,
+    const char *fmt,
+    va_list args
+) {
+    if (!g_logger.initialized || !g_logger.enabled) return;
+
+    // Storm suppression applies to macro call sites; the rate limit is
+    // checked before anything is formatted. With it off the site is not
+    // written to, so a hot site logged from several threads shares nothing.
+    uint64_t now_ns = 0;
+    bool suppress   = site && level != DREAM_LOG_FATAL &&
+                    (g_logger.rate_interval_ns || g_logger.collapse_repeats);
+    if (suppress) {
+        now_ns = dream_coarse_ns();
+        if (g_logger.rate_interval_ns && !dream_log_rate_allow(site, now_ns)) {
+            if (!atomic_fetch_add_explicit(
+                    &site->suppressed, 1, memory_order_relaxed
+                ))
+                dream_log_site_track(site, level);
+            return;
+        }
+    }
+
+    DreamLogMsg log;
+    log.level       = level;
+    log.threadid    = dream_thread_id();
+    log.pid         = g_logger.pid;
+    log.timestamp   = dream_log_now();
+    log.category_id = category;
+    log.category    = dream_log_category_name(category);
+    log.fmt         = nullptr;
+    log.args        = log.message;
+    log.args_size   = 0;
+    log.has_text    = false;
+
+    if (g_logger.async_enabled && g_logger.async_deferred_format) {
+        va_list packed_args;
+        va_copy(packed_args, args);
+        size_t packed = _dream_log_pack_args(
+            fmt, packed_args, log.message, sizeof(log.message)
+        );
+        va_end(packed_args);
+        if (packed != DREAM_LOG_PACK_FAILED) {
+            log.fmt       = fmt;
+            log.args_size = (uint32_t)packed;
+        }
+    }
+    if (!log.fmt) {
+        vsnprintf(log.message, sizeof(log.message), fmt, args);
+        log.has_text = true;
+    }
+
+    if (suppress && !dream_log_site_admit(site, &log, now_ns)) return;
 
     if (g_logger.async_enabled) {
-        dream_async_push(&log);
+        dream_async_push(dream_async_queue_for_thread(), &log);
     } else {
-        // synchronous dispatch
-        for (size_t i = 0; i < g_logger.sink_count; ++i) {
-            DreamLoggerSink *sink = g_logger.sinks[i];
-            if (log.level >= sink->min_level) sink->__write(sink, &log);
-        }
+        dream_dispatch(&log); // synchronous dispatch
     }
 
     if (level == DREAM_LOG_FATAL) {
@@ -549,25 +3684,167 @@ void DreamLog(DreamLogLevel level, const char *category, const char *fmt, ...) {
     }
 }
 
-void DreamLoggerDumpRingBuffer(FILE *out) {
-    DreamRingBuffer *r = &g_logger.ring;
+void DreamLogWithCategory(
+    DreamLogLevel level, DreamLogCategoryId category, const char *fmt, ...
+) {
+    if (!DreamLogCategoryEnabled(category, level)) return;
+
+    va_list args;
+    va_start(args, fmt);
+    dream_log_v(level, category, nullptr, fmt, args);
+    va_end(args);
+}
+
+void DreamLog(DreamLogLevel level, const char *category, const char *fmt, ...) {
+    DreamLogCategoryId id = DreamLogCategory(category);
+    if (!DreamLogCategoryEnabled(id, level)) return;
+
+    va_list args;
+    va_start(args, fmt);
+    dream_log_v(level, id, nullptr, fmt, args);
+    va_end(args);
+}
+
+void DreamLogAtSite(
+    DreamLogLevel level, DreamLogSite *site, const char *fmt, ...
+) {
+    DreamLogCategoryId id = (DreamLogCategoryId)(
+        atomic_load_explicit(&site->category, memory_order_relaxed) - 1
+    );
+
+    va_list args;
+    va_start(args, fmt);
+    dream_log_v(level, id, site, fmt, args);
+    va_end(args);
+}
+
+static void dream_stats_add_queue(DreamLoggerStats *out, DLMRingBuffer *q) {
+    out->enqueued += atomic_load_explicit(&q->enqueued, memory_order_relaxed);
+    out->dropped_newest +=
+        atomic_load_explicit(&q->dropped_newest, memory_order_relaxed);
+    out->dropped_oldest +=
+        atomic_load_explicit(&q->dropped_oldest, memory_order_relaxed);
+    out->blocked += atomic_load_explicit(&q->blocked, memory_order_relaxed);
+    out->blocked_ns +=
+        atomic_load_explicit(&q->blocked_ns, memory_order_relaxed);
+
+    size_t high = atomic_load_explicit(&q->high_water, memory_order_relaxed);
+    uint32_t percent = (uint32_t)(high * 100 / q->cell_count);
+    if (percent > out->queue_high_water_percent ||
+        (percent == out->queue_high_water_percent &&
+         high * DREAM_LOG_CELL_SIZE > out->queue_high_water_bytes)) {
+        out->queue_high_water_percent = percent;
+        out->queue_high_water_bytes   = high * DREAM_LOG_CELL_SIZE;
+    }
+}
 
-    if (!r->buffer || r->count == 0) return;
+void DreamLoggerGetStats(DreamLoggerStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (!g_logger.async_enabled) return;
+
+    dream_stats_add_queue(out, &g_logger.async_ringbuff);
+    for (DreamLogThreadQueue *tq = atomic_load_explicit(
+             &g_logger.thread_queues, memory_order_acquire
+         );
+         tq;
+         tq = tq->next)
+        dream_stats_add_queue(out, &tq->ring);
+
+    out->written =
+        atomic_load_explicit(&g_logger.stats_written, memory_order_relaxed);
+    out->latency_max_ns = atomic_load_explicit(
+        &g_logger.stats_latency_max_ns, memory_order_relaxed
+    );
+    for (uint32_t i = 0; i < DREAM_LOG_LATENCY_BUCKETS; ++i)
+        out->latency_buckets[i] = atomic_load_explicit(
+            &g_logger.stats_latency[i], memory_order_relaxed
+        );
+}
 
-    fprintf(out, "---- Dream Ring Buffer Dump (%u entries) ----\n", r->count);
+void DreamLoggerGetSinkStats(
+    const DreamLoggerSink *sink, DreamLoggerSinkStats *out
+) {
+    memset(out, 0, sizeof(*out));
+    DreamLogSinkWorker *w = sink->__worker;
+    if (!w) return;
+
+    DLMRingBuffer *q = &w->backlog;
+    out->enqueued = atomic_load_explicit(&q->enqueued, memory_order_relaxed);
+    out->dropped =
+        atomic_load_explicit(&q->dropped_newest, memory_order_relaxed);
+    out->written = atomic_load_explicit(&w->written, memory_order_relaxed);
+    out->backlog_high_water_percent = (uint32_t)(
+        atomic_load_explicit(&q->high_water, memory_order_relaxed) * 100 /
+        q->cell_count
+    );
+}
 
-    uint32_t start = (r->head + r->capacity - r->count) % r->capacity;
+uint64_t DreamLoggerLatencyBucketNs(uint32_t bucket) {
+    if (bucket < 8) return bucket;
+    if (bucket >= DREAM_LOG_LATENCY_BUCKETS) return UINT64_MAX;
+    return (uint64_t)(8 + bucket % 8) << (bucket / 8 - 1);
+}
 
-    for (uint32_t i = 0; i < r->count; ++i) {
-        uint32_t idx     = (start + i) % r->capacity;
-        const char *line = r->buffer + (idx * r->line_len);
-        fputs(line, out);
+uint64_t
+DreamLoggerLatencyPercentile(const DreamLoggerStats *stats, double percentile) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < DREAM_LOG_LATENCY_BUCKETS; ++i)
+        total += stats->latency_buckets[i];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(total * percentile / 100.0 + 0.5);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < DREAM_LOG_LATENCY_BUCKETS - 1; ++i) {
+        seen += stats->latency_buckets[i];
+        if (seen < rank) continue;
+        uint64_t bound = DreamLoggerLatencyBucketNs(i + 1);
+        return bound < stats->latency_max_ns ? bound : stats->latency_max_ns;
     }
+    return stats->latency_max_ns;
+}
+
+static void dream_ring_buffer_print(const char *text, size_t len, void *out) {
+    fwrite(text, 1, len, out);
+}
+
+void DreamLoggerDumpRingBuffer(FILE *out) {
+    DreamRingBuffer *r = &g_logger.ring;
+
+    if (!r->header) return;
+    uint64_t next =
+        atomic_load_explicit(&r->header->next, memory_order_acquire);
+    if (next == 0) return;
+    uint64_t count =
+        next < r->header->slot_count ? next : r->header->slot_count;
 
+    fprintf(
+        out,
+        "---- Dream Ring Buffer Dump (%llu entries) ----\n",
+        (unsigned long long)count
+    );
+    _dream_log_flight_read(r->header, r->size, dream_ring_buffer_print, out);
     fprintf(out, "--------------------------------------------\n");
     fflush(out);
 }
 
+long DreamLoggerDumpRingFile(const char *path, FILE *out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    void *ring = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        ring = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) return -1;
+
+    long lines = _dream_log_flight_read(
+        ring, (size_t)st.st_size, dream_ring_buffer_print, out
+    );
+    munmap(ring, (size_t)st.st_size);
+    fflush(out);
+    return lines;
+}
+
 #endif
 
 #endif // !REMOVE_DREAM_LOGGER
@@ -0,0 +1,328 @@
+#include <Dream/Memory.h>
+
+#include "Allocator.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <threads.h>
+
+#define DREAM_FRAME_MIN_CHUNK (256 * 1024)
+#define DREAM_POOL_MAX_CACHED 64 // pools with thread caches, the rest lock
+#define DREAM_POOL_BATCH 32      // objects moved between a cache and a pool
+#define DREAM_POOL_BLOCK_BYTES (64 * 1024)
+
+// Chunks and pools keep the allocator they came from, which DreamShutdown
+// may have swapped out by the time they are freed.
+typedef struct DreamFrameChunk {
+    struct DreamFrameChunk *prev;
+    size_t size; // this header included
+    DreamUserAllocator allocator;
+} DreamFrameChunk;
+
+typedef struct DreamPoolObject {
+    struct DreamPoolObject *next;
+} DreamPoolObject;
+
+typedef struct DreamPoolBlock {
+    struct DreamPoolBlock *next;
+} DreamPoolBlock;
+
+struct DreamPool {
+    size_t stride;
+    size_t alignment;
+    size_t block_bytes;
+    size_t first_offset; // of the first object in a block
+    uint32_t per_block;
+    uint32_t slot; // in g_dream_pools, DREAM_POOL_MAX_CACHED: none
+    uint64_t id;
+    DreamUserAllocator allocator; // the pool and its blocks come from it
+    mtx_t lock;
+    DreamPoolObject *free;
+    DreamPoolBlock *blocks;
+};
+
+// Free objects of the pool with `id`; a cache whose pool was destroyed
+// is found out by the id and dropped, its objects went with the pool.
+typedef struct DreamPoolCache {
+    uint64_t id;
+    DreamPoolObject *head;
+    uint32_t count;
+} DreamPoolCache;
+
+typedef struct DreamMemoryThread {
+    DreamFrameChunk *chunk; // newest, the one being allocated from
+    char *cursor;
+    char *end;
+    size_t frame_bytes; // in all chunks
+    uint64_t frame;
+    bool registered; // with g_dream_memory_key, to be cleaned up on exit
+    DreamPoolCache caches[DREAM_POOL_MAX_CACHED];
+} DreamMemoryThread;
+
+static thread_local DreamMemoryThread t_memory;
+static _Atomic uint64_t g_dream_frame;
+
+static once_flag g_dream_memory_once = ONCE_FLAG_INIT;
+static tss_t g_dream_memory_key;
+// Guards g_dream_pools and g_dream_pool_ids, and keeps a pool alive while
+// an exiting thread hands its cache back.
+static mtx_t g_dream_pools_lock;
+static DreamPool *g_dream_pools[DREAM_POOL_MAX_CACHED];
+static uint64_t g_dream_pool_ids;
+
+static void dream_frame_free(DreamMemoryThread *t) {
+    while (t->chunk) {
+        DreamFrameChunk *c           = t->chunk;
+        DreamUserAllocator allocator = c->allocator; // outlives c
+        t->chunk                     = c->prev;
+        _dream_free_pages_with(&allocator, DREAM_MEMORY_FRAME, c, c->size);
+    }
+    t->cursor      = nullptr;
+    t->end         = nullptr;
+    t->frame_bytes = 0;
+}
+
+static void dream_memory_thread_exit(void *arg) {
+    DreamMemoryThread *t = arg;
+    dream_frame_free(t);
+
+    mtx_lock(&g_dream_pools_lock);
+    for (uint32_t i = 0; i < DREAM_POOL_MAX_CACHED; ++i) {
+        DreamPoolCache *c = &t->caches[i];
+        DreamPool *pool   = g_dream_pools[i];
+        if (c->head && pool && pool->id == c->id) {
+            DreamPoolObject *last = c->head;
+            while (last->next) last = last->next;
+            mtx_lock(&pool->lock);
+            last->next = pool->free;
+            pool->free = c->head;
+            mtx_unlock(&pool->lock);
+        }
+        *c = (DreamPoolCache){0};
+    }
+    mtx_unlock(&g_dream_pools_lock);
+    t->registered = false;
+}
+
+static void dream_memory_init(void) {
+    tss_create(&g_dream_memory_key, dream_memory_thread_exit);
+    mtx_init(&g_dream_pools_lock, mtx_plain);
+}
+
+static void dream_memory_register(DreamMemoryThread *t) {
+    call_once(&g_dream_memory_once, dream_memory_init);
+    tss_set(g_dream_memory_key, t);
+    t->registered = true;
+}
+
+static bool dream_frame_chunk(DreamMemoryThread *t, size_t size) {
+    DreamUserAllocator allocator;
+    _dream_memory_allocator(&allocator);
+    DreamFrameChunk *c =
+        _dream_alloc_pages_with(&allocator, DREAM_MEMORY_FRAME, size);
+    if (!c) return false;
+    c->prev      = t->chunk;
+    c->size      = size;
+    c->allocator = allocator;
+    t->chunk  = c;
+    t->cursor = (char *)(c + 1);
+    t->end    = (char *)c + size;
+    t->frame_bytes += size;
+    return true;
+}
+
+// Called on the first allocation of a frame. Chunks added during the last
+// frame are merged, so a steady workload settles on a single chunk.
+static void dream_frame_rewind(DreamMemoryThread *t) {
+    if (!t->chunk) return;
+    if (t->chunk->prev) {
+        size_t bytes = t->frame_bytes;
+        dream_frame_free(t);
+        dream_frame_chunk(t, bytes); // else the next allocation retries
+    } else {
+        t->cursor = (char *)(t->chunk + 1);
+    }
+}
+
+void *DreamFrameAlloc(size_t size, size_t alignment) {
+    DreamMemoryThread *t = &t_memory;
+    uint64_t frame = atomic_load_explicit(&g_dream_frame, memory_order_acquire);
+    if (t->frame != frame) {
+        t->frame = frame;
+        dream_frame_rewind(t);
+    }
+    if (!alignment) alignment = alignof(max_align_t);
+
+    uintptr_t p = ((uintptr_t)t->cursor + alignment - 1) & ~(alignment - 1);
+    if (t->cursor && p <= (uintptr_t)t->end &&
+        size <= (uintptr_t)t->end - p) {
+        t->cursor = (char *)(p + size);
+        return (void *)p;
+    }
+
+    size_t need = sizeof(DreamFrameChunk) + alignment + size;
+    if (need < size) return nullptr;
+    size_t bytes = t->chunk ? 2 * t->chunk->size : DREAM_FRAME_MIN_CHUNK;
+    while (bytes < need) bytes *= 2;
+    if (!t->registered) dream_memory_register(t);
+    if (!dream_frame_chunk(t, bytes)) return nullptr;
+
+    p = ((uintptr_t)t->cursor + alignment - 1) & ~(alignment - 1);
+    t->cursor = (char *)(p + size);
+    return (void *)p;
+}
+
+void DreamFrameEnd(void) {
+    atomic_fetch_add_explicit(&g_dream_frame, 1, memory_order_release);
+}
+
+uint64_t DreamFrameIndex(void) {
+    return atomic_load_explicit(&g_dream_frame, memory_order_acquire);
+}
+
+void DreamFrameRelease(void) {
+    dream_frame_free(&t_memory);
+}
+
+DreamPool *DreamPoolCreate(size_t object_size, size_t alignment) {
+    call_once(&g_dream_memory_once, dream_memory_init);
+    if (alignment < alignof(DreamPoolObject))
+        alignment = alignof(DreamPoolObject);
+    if (object_size < sizeof(DreamPoolObject))
+        object_size = sizeof(DreamPoolObject);
+
+    DreamUserAllocator allocator;
+    _dream_memory_allocator(&allocator);
+    DreamPool *pool =
+        _dream_alloc_with(&allocator, DREAM_MEMORY_POOL, sizeof(*pool), 0);
+    if (!pool) return nullptr;
+    *pool = (DreamPool){
+        .stride    = (object_size + alignment - 1) & ~(alignment - 1),
+        .alignment = alignment,
+        .allocator = allocator,
+        .first_offset =
+            (sizeof(DreamPoolBlock) + alignment - 1) & ~(alignment - 1),
+    };
+    // At least a batch per block.
+    size_t min_block  = pool->first_offset + DREAM_POOL_BATCH * pool->stride;
+    pool->block_bytes = DREAM_POOL_BLOCK_BYTES;
+    if (pool->block_bytes < min_block) pool->block_bytes = min_block;
+    pool->per_block =
+        (uint32_t)((pool->block_bytes - pool->first_offset) / pool->stride);
+    mtx_init(&pool->lock, mtx_plain);
+
+    mtx_lock(&g_dream_pools_lock);
+    pool->id   = ++g_dream_pool_ids;
+    pool->slot = 0;
+    while (pool->slot < DREAM_POOL_MAX_CACHED && g_dream_pools[pool->slot])
+        ++pool->slot;
+    if (pool->slot < DREAM_POOL_MAX_CACHED) g_dream_pools[pool->slot] = pool;
+    mtx_unlock(&g_dream_pools_lock);
+    return pool;
+}
+
+void DreamPoolDestroy(DreamPool *pool) {
+    if (!pool) return;
+    mtx_lock(&g_dream_pools_lock);
+    if (pool->slot < DREAM_POOL_MAX_CACHED) g_dream_pools[pool->slot] = nullptr;
+    mtx_unlock(&g_dream_pools_lock);
+
+    DreamUserAllocator allocator = pool->allocator;
+    while (pool->blocks) {
+        DreamPoolBlock *next = pool->blocks->next;
+        _dream_free_with(
+            &allocator, DREAM_MEMORY_POOL, pool->blocks, pool->block_bytes
+        );
+        pool->blocks = next;
+    }
+    mtx_destroy(&pool->lock);
+    _dream_free_with(&allocator, DREAM_MEMORY_POOL, pool, sizeof(*pool));
+}
+
+static DreamPoolCache *dream_pool_cache(DreamPool *pool) {
+    if (pool->slot >= DREAM_POOL_MAX_CACHED) return nullptr;
+    DreamMemoryThread *t = &t_memory;
+    DreamPoolCache *c    = &t->caches[pool->slot];
+    if (c->id != pool->id) {
+        if (!t->registered) dream_memory_register(t);
+        *c = (DreamPoolCache){.id = pool->id};
+    }
+    return c;
+}
+
+// Called with the pool's lock held.
+static bool dream_pool_grow(DreamPool *pool) {
+    DreamPoolBlock *block = _dream_alloc_with(
+        &pool->allocator, DREAM_MEMORY_POOL, pool->block_bytes, pool->alignment
+    );
+    if (!block) return false;
+    block->next  = pool->blocks;
+    pool->blocks = block;
+
+    // Pushed last to first, so objects come out in address order.
+    char *first = (char *)block + pool->first_offset;
+    for (uint32_t i = pool->per_block; i-- > 0;) {
+        DreamPoolObject *o = (DreamPoolObject *)(first + i * pool->stride);
+        o->next            = pool->free;
+        pool->free         = o;
+    }
+    return true;
+}
+
+void *DreamPoolAlloc(DreamPool *pool) {
+    DreamPoolCache *c = dream_pool_cache(pool);
+    if (c && c->head) {
+        DreamPoolObject *o = c->head;
+        c->head            = o->next;
+        --c->count;
+        return o;
+    }
+
+    mtx_lock(&pool->lock);
+    if (!pool->free && !dream_pool_grow(pool)) {
+        mtx_unlock(&pool->lock);
+        return nullptr;
+    }
+    DreamPoolObject *o = pool->free;
+    pool->free         = o->next;
+    // Refill the cache with the rest of a batch.
+    if (c) {
+        while (c->count < DREAM_POOL_BATCH - 1 && pool->free) {
+            DreamPoolObject *next = pool->free;
+            pool->free            = next->next;
+            next->next            = c->head;
+            c->head               = next;
+            ++c->count;
+        }
+    }
+    mtx_unlock(&pool->lock);
+    return o;
+}
+
+void DreamPoolFree(DreamPool *pool, void *object) {
+    if (!object) return;
+    DreamPoolObject *o = object;
+    DreamPoolCache *c  = dream_pool_cache(pool);
+    if (c) {
+        o->next = c->head;
+        c->head = o;
+        if (++c->count < 2 * DREAM_POOL_BATCH) return;
+
+        // Hand a batch back so objects freed here can be used elsewhere.
+        DreamPoolObject *first = c->head;
+        DreamPoolObject *last  = first;
+        for (uint32_t i = 1; i < DREAM_POOL_BATCH; ++i) last = last->next;
+        c->head = last->next;
+        c->count -= DREAM_POOL_BATCH;
+        mtx_lock(&pool->lock);
+        last->next = pool->free;
+        pool->free = first;
+        mtx_unlock(&pool->lock);
+        return;
+    }
+    mtx_lock(&pool->lock);
+    o->next    = pool->free;
+    pool->free = o;
+    mtx_unlock(&pool->lock);
+}
@@ -0,0 +1,65 @@
+#include "DreamInternalAPI.h"
+
+#include <assert.h>
+
+static_assert(
+    (DREAM_EVENT_QUEUE_CAPACITY & (DREAM_EVENT_QUEUE_CAPACITY - 1)) == 0,
+    "the event ring wraps with a mask"
+);
+#define DREAM_EVENT_MASK (DREAM_EVENT_QUEUE_CAPACITY - 1)
+
+void _dream_push_event(
+    _DreamWindow *w,
+    DreamEventKind kind,
+    uint16_t code,
+    float dx,
+    float dy,
+    uint32_t t
+) {
+    DreamEventRing *r = &w->events;
+    uint32_t tail     = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t head     = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head >= DREAM_EVENT_QUEUE_CAPACITY) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    uint32_t i = tail & DREAM_EVENT_MASK;
+    r->kind[i] = (uint8_t)kind;
+    r->code[i] = code;
+    r->time[i] = t;
+    r->x[i]    = w->inputState.ps.position.x;
+    r->y[i]    = w->inputState.ps.position.y;
+    r->dx[i]   = dx;
+    r->dy[i]   = dy;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+uint32_t DreamDrainEvents(DreamWindow *window, DreamEvent *out, uint32_t max) {
+    DreamEventRing *r = &((_DreamWindow *)window)->events;
+    uint32_t head     = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail     = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t count    = tail - head;
+    if (count > max) count = max;
+
+    for (uint32_t n = 0; n < count; ++n) {
+        uint32_t i = (head + n) & DREAM_EVENT_MASK;
+
+        out[n] = (DreamEvent){
+            .kind = (DreamEventKind)r->kind[i],
+            .time = r->time[i],
+            .code = r->code[i],
+            .x    = r->x[i],
+            .y    = r->y[i],
+            .dx   = r->dx[i],
+            .dy   = r->dy[i],
+        };
+    }
+    atomic_store_explicit(&r->head, head + count, memory_order_release);
+    return count;
+}
+
+uint64_t DreamGetDroppedEventCount(DreamWindow *window) {
+    return atomic_load_explicit(
+        &((_DreamWindow *)window)->events.dropped, memory_order_relaxed
+    );
+}
@@ -0,0 +1,161 @@
+#include "DreamInternalAPI.h"
+
+#include <Dream/Dream.h>
+
+#include <stdatomic.h>
+#include <string.h>
+#include <threads.h>
+
+static struct {
+    DreamInputPumpFn pump;
+    DreamInputWakeFn wake;
+    void *platform;
+    thrd_t thread;
+    atomic_bool running;
+    bool started;
+} g_dream_input;
+
+static inline void dream_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+void _dream_publish_input(_DreamWindow *w) {
+    uint64_t words[DREAM_INPUT_SNAPSHOT_WORDS] = {0};
+    memcpy(words, &w->inputState, sizeof(InputState));
+
+    DreamInputSnapshot *s = &w->published;
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < DREAM_INPUT_SNAPSHOT_WORDS; ++i)
+        atomic_store_explicit(&s->words[i], words[i], memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+void _dream_read_input(_DreamWindow *w, InputState *out) {
+    DreamInputSnapshot *s = &w->published;
+    uint64_t words[DREAM_INPUT_SNAPSHOT_WORDS];
+    for (;;) {
+        uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq & 1) {
+            dream_cpu_relax();
+            continue;
+        }
+        for (size_t i = 0; i < DREAM_INPUT_SNAPSHOT_WORDS; ++i)
+            words[i] =
+                atomic_load_explicit(&s->words[i], memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq) break;
+    }
+    memcpy(out, words, sizeof(InputState));
+}
+
+void _dream_input_set_pump(
+    DreamInputPumpFn pump, DreamInputWakeFn wake, void *platform
+) {
+    g_dream_input.pump     = pump;
+    g_dream_input.wake     = wake;
+    g_dream_input.platform = platform;
+}
+
+bool _dream_input_on_thread(void) {
+    return atomic_load_explicit(&g_dream_input.running, memory_order_acquire);
+}
+
+// A pump that fails has lost its connection: the thread clears `running`
+// on the way out, so DreamPollEvents goes back to pumping and the dead
+// connection is not woken.
+static int DreamInputThreadFn(void *args) {
+    DreamLoggerInstallSignalStack();
+    while (atomic_load_explicit(&g_dream_input.running, memory_order_acquire))
+        if (!g_dream_input.pump(g_dream_input.platform)) break;
+    atomic_store_explicit(&g_dream_input.running, false, memory_order_release);
+    return 0;
+}
+
+bool DreamSetInputThread(bool enabled) {
+    if (g_dream_input.started) {
+        bool running = atomic_exchange_explicit(
+            &g_dream_input.running, enabled, memory_order_acq_rel
+        );
+        if (running && enabled) return true;
+        // Stopping a live thread, or reaping one that ended on its own.
+        if (running) g_dream_input.wake(g_dream_input.platform);
+        thrd_join(g_dream_input.thread, nullptr);
+        g_dream_input.started = false;
+    }
+    if (!enabled) return true;
+
+    if (!g_dream_input.pump || !g_dream_input.wake) return false;
+    atomic_store_explicit(&g_dream_input.running, true, memory_order_release);
+    if (thrd_create(&g_dream_input.thread, DreamInputThreadFn, nullptr) !=
+        thrd_success) {
+        atomic_store_explicit(
+            &g_dream_input.running, false, memory_order_release
+        );
+        return false;
+    }
+    g_dream_input.started = true;
+    return true;
+}
+
+static bool dream_key_bit(const InputState *s, KeyCode key) {
+    if ((unsigned)key >= KEY_COUNT) return false;
+    return (s->ks.keyState_bits[key / 64] >> (key % 64)) & 1;
+}
+
+static bool dream_mouse_btn_bit(const InputState *s, MouseButtonCode btn) {
+    if ((unsigned)btn >= MOUSE_BUTTON_COUNT) return false;
+    return (s->ps.mouseBtnState_bits >> btn) & 1;
+}
+
+KeyState DreamGetKeyState(DreamWindow *window, KeyCode key) {
+    InputState s;
+    _dream_read_input((_DreamWindow *)window, &s);
+    return dream_key_bit(&s, key) ? PRESSED : UNPRESSED;
+}
+
+KeyState DreamGetMouseBtnState(DreamWindow *window, MouseButtonCode key) {
+    InputState s;
+    _dream_read_input((_DreamWindow *)window, &s);
+    return dream_mouse_btn_bit(&s, key) ? PRESSED : UNPRESSED;
+}
+
+bool DreamIsKeyPressed(DreamWindow *window, KeyCode key) {
+    return DreamGetKeyState(window, key) == PRESSED;
+}
+
+bool DreamIsKeyReleased(DreamWindow *window, KeyCode key) {
+    return DreamGetKeyState(window, key) == UNPRESSED;
+}
+
+bool DreamIsMouseBtnPressed(DreamWindow *window, MouseButtonCode key) {
+    return DreamGetMouseBtnState(window, key) == PRESSED;
+}
+
+bool DreamIsMouseBtnReleased(DreamWindow *window, MouseButtonCode key) {
+    return DreamGetMouseBtnState(window, key) == UNPRESSED;
+}
+
+void DreamGetMousePosition(DreamWindow *window, float *x, float *y) {
+    InputState s;
+    _dream_read_input((_DreamWindow *)window, &s);
+    *x = s.ps.position.x;
+    *y = s.ps.position.y;
+}
+
+float DreamGetMouseX(DreamWindow *window) {
+    float x, y;
+    DreamGetMousePosition(window, &x, &y);
+    return x;
+}
+
+float DreamGetMouseY(DreamWindow *window) {
+    float x, y;
+    DreamGetMousePosition(window, &x, &y);
+    return y;
+}
@@ -45,29 +45,66 @@ void _dream_update_next_window(
     current_window->next = next_window;
 }
 
-void _dream_register_keypress(_DreamWindow *w, KeyCode kc) {
+void _dream_register_keypress(_DreamWindow *w, KeyCode kc, uint32_t t) {
     w->inputState.ks.keyState_bits[kc / 64] |= (1ULL << (kc % 64));
+    w->inputState.ks.last_keyPress_time = t;
+    _dream_push_event(w, DREAM_EVENT_KEY_PRESS, kc, 0, 0, t);
 }
 
-void _dream_register_keyrelease(_DreamWindow *w, KeyCode kc) {
+void _dream_register_keyrelease(_DreamWindow *w, KeyCode kc, uint32_t t) {
     w->inputState.ks.keyState_bits[kc / 64] &= ~(1ULL << (kc % 64));
+    _dream_push_event(w, DREAM_EVENT_KEY_RELEASE, kc, 0, 0, t);
 }
 
-void _dream_register_mousebtn_press(_DreamWindow *w, MouseButtonCode mbc) {
+void _dream_register_mousebtn_press(
+    _DreamWindow *w, MouseButtonCode mbc, uint32_t t
+) {
     w->inputState.ps.mouseBtnState_bits |= (1 << mbc);
     w->inputState.ps.last_pressed_btn = (MouseButtonCode)mbc;
+    _dream_push_event(w, DREAM_EVENT_MOUSE_BTN_PRESS, mbc, 0, 0, t);
 }
 
-void _dream_register_mousebtn_release(_DreamWindow *w, MouseButtonCode mbc) {
+void _dream_register_mousebtn_release(
+    _DreamWindow *w, MouseButtonCode mbc, uint32_t t
+) {
     w->inputState.ps.mouseBtnState_bits &= ~(1 << mbc);
+    _dream_push_event(w, DREAM_EVENT_MOUSE_BTN_RELEASE, mbc, 0, 0, t);
+}
+
+void _dream_register_scroll(
+    _DreamWindow *w, float amt, ScrollDir dir, uint32_t t
+) {
+    _dream_push_event(
+        w, DREAM_EVENT_MOUSE_SCROLL, 0, 0, dir == SCROLL_UP ? amt : -amt, t
+    );
 }
 
-void _dream_update_mouse_pos(_DreamWindow *w, uint16_t x, uint16_t y) {
+void _dream_update_mouse_pos(
+    _DreamWindow *w, uint16_t x, uint16_t y, uint32_t t
+) {
+    float dx = 0, dy = 0;
+    if (w->inputState.ps.position_known) {
+        dx = x - w->inputState.ps.position.x;
+        dy = y - w->inputState.ps.position.y;
+    }
     w->inputState.ps.position.x = x;
     w->inputState.ps.position.y = y;
+    w->inputState.ps.position_known = true;
+    _dream_push_event(w, DREAM_EVENT_MOUSE_MOVE, 0, dx, dy, t);
+}
+
+void _dream_register_mouse_leave(_DreamWindow *w) {
+    w->inputState.ps.position_known = false;
 }
 
-void _dream_update_mouse_delta(_DreamWindow *w, int16_t dx, int16_t dy) {}
+void _dream_update_mouse_delta(
+    _DreamWindow *w, int16_t dx, int16_t dy, uint32_t t
+) {
+    w->inputState.ps.relative_motion.x = dx;
+    w->inputState.ps.relative_motion.y = dy;
+    w->inputState.ps.relative_motion_timestamp = t;
+    _dream_push_event(w, DREAM_EVENT_MOUSE_RAW_MOTION, 0, dx, dy, t);
+}
 
 void _dream_update_lastbtnpress_pos(_DreamWindow *w, uint16_t x, uint16_t y) {
     w->inputState.ps.last_btn_press_position.x = x;
@@ -21,14 +21,30 @@ void _dream_update_next_window(
     _DreamWindow *current_window, _DreamWindow *next_window
 );
 
-void _dream_register_keypress(_DreamWindow *w, KeyCode kc);
-void _dream_register_keyrelease(_DreamWindow *w, KeyCode kc);
+// Input: `t` is the event's X server timestamp. Each of these updates the
+// latest state and queues the event for DreamDrainEvents.
+void _dream_register_keypress(_DreamWindow *w, KeyCode kc, uint32_t t);
+void _dream_register_keyrelease(_DreamWindow *w, KeyCode kc, uint32_t t);
 
-void _dream_register_mousebtn_press(_DreamWindow *w, MouseButtonCode mbc);
-void _dream_register_mousebtn_release(_DreamWindow *w, MouseButtonCode mbc);
+void _dream_register_mousebtn_press(
+    _DreamWindow *w, MouseButtonCode mbc, uint32_t t
+);
+void _dream_register_mousebtn_release(
+    _DreamWindow *w, MouseButtonCode mbc, uint32_t t
+);
+void _dream_register_scroll(
+    _DreamWindow *w, float amt, ScrollDir dir, uint32_t t
+);
 
-void _dream_update_mouse_pos(_DreamWindow *w, uint16_t x, uint16_t y);
-void _dream_update_mouse_delta(_DreamWindow *w, int16_t dx, int16_t dy);
+// The first position after the pointer enters the window moves it with
+// a zero delta; _dream_register_mouse_leave forgets the position again.
+void _dream_update_mouse_pos(
+    _DreamWindow *w, uint16_t x, uint16_t y, uint32_t t
+);
+void _dream_register_mouse_leave(_DreamWindow *w);
+void _dream_update_mouse_delta(
+    _DreamWindow *w, int16_t dx, int16_t dy, uint32_t t
+);
 
 void _dream_update_lastbtnpress_pos(_DreamWindow *w, uint16_t x, uint16_t y);
 
@@ -36,4 +52,30 @@ void _dream_update_mouse_motion_timestamp(_DreamWindow *w, uint32_t t);
 
 void _dream_update_lastbtnpress_timestamp(_DreamWindow *w, uint32_t t);
 
+// Queues an event for DreamDrainEvents at the current pointer position.
+void _dream_push_event(
+    _DreamWindow *w,
+    DreamEventKind kind,
+    uint16_t code,
+    float dx,
+    float dy,
+    uint32_t t
+);
+
+// Makes inputState visible to the state queries; called by the event pump
+// once it has handled the events it had.
+void _dream_publish_input(_DreamWindow *w);
+void _dream_read_input(_DreamWindow *w, InputState *out);
+
+// Registered by the platform layer at init. `pump` waits for events,
+// handles them and publishes the windows they touched; it returns false
+// once the connection is gone. `wake` makes a waiting pump return.
+typedef bool (*DreamInputPumpFn)(void *platform);
+typedef void (*DreamInputWakeFn)(void *platform);
+void _dream_input_set_pump(
+    DreamInputPumpFn pump, DreamInputWakeFn wake, void *platform
+);
+// True while the input thread pumps; DreamPollEvents must not.
+bool _dream_input_on_thread(void);
+
 #endif // DREAM_INTERNAL_API
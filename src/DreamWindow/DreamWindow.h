@@ -2,6 +2,9 @@
 #define DREAM_WINDOW_H
 
 #include <Dream/KeyCodes.h>
+#include <Dream/Window.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "Dream/_callbackSig.h"
@@ -18,6 +21,7 @@ typedef struct PointerState {
     uint32_t last_btn_press_timestamp;
     uint8_t mouseBtnState_bits;
     MouseButtonCode last_pressed_btn;
+    bool position_known; // false until the first motion after entering
 } PointerState;
 
 typedef struct KeyboardState {
@@ -30,6 +34,33 @@ typedef struct InputState {
     KeyboardState ks;
 } InputState;
 
+// inputState as last published, for the state queries on any thread. A
+// seqlock with one writer, the event pump: `seq` is odd while the words
+// are being rewritten. The words are atomics so readers that overlap a
+// write are retried rather than racing.
+#define DREAM_INPUT_SNAPSHOT_WORDS ((sizeof(InputState) + 7) / 8)
+
+typedef struct DreamInputSnapshot {
+    _Atomic uint32_t seq;
+    _Atomic uint64_t words[DREAM_INPUT_SNAPSHOT_WORDS];
+} DreamInputSnapshot;
+
+// Input events waiting for DreamDrainEvents, one array per field so a
+// drain reads each field sequentially. Single producer (whoever pumps the
+// platform's events), single consumer; head and tail only grow.
+typedef struct DreamEventRing {
+    uint8_t kind[DREAM_EVENT_QUEUE_CAPACITY]; // DreamEventKind
+    uint16_t code[DREAM_EVENT_QUEUE_CAPACITY];
+    uint32_t time[DREAM_EVENT_QUEUE_CAPACITY];
+    float x[DREAM_EVENT_QUEUE_CAPACITY];
+    float y[DREAM_EVENT_QUEUE_CAPACITY];
+    float dx[DREAM_EVENT_QUEUE_CAPACITY];
+    float dy[DREAM_EVENT_QUEUE_CAPACITY];
+    _Atomic uint32_t head; // next to drain
+    _Atomic uint32_t tail; // next to fill
+    _Atomic uint64_t dropped;
+} DreamEventRing;
+
 typedef struct DreamWindow {
     struct DreamWindow *next;
 
@@ -43,7 +74,9 @@ typedef struct DreamWindow {
     bool isBorderless;
     bool isResizable;
 
-    InputState inputState;
+    InputState inputState; // the pump's own, published after each batch
+    DreamEventRing events;
+    alignas(64) DreamInputSnapshot published;
 
     struct {
         DWindowResizeFn onResize;
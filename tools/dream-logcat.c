@@ -0,0 +1,479 @@
+// dream-logcat: decodes, filters and prints binary log files written by
+// DREAM_LOG_SINK_BINARY, and recovers the lines in a flight recorder ring
+// (ring_buffer_path). Both layouts are described in LogFormat.h.
+
+#include <Dream/Dream.h>
+
+#include "LogFormat.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DREAM_LOGCAT_MAX_MESSAGE 4096
+#define DREAM_LOGCAT_MAX_FILTERS 32
+
+typedef struct DreamLogcatString {
+    char *data; // NUL terminated copy
+    size_t len;
+} DreamLogcatString;
+
+typedef struct DreamLogcatDict {
+    DreamLogcatString *entries;
+    size_t capacity;
+    size_t count; // defined entries
+} DreamLogcatDict;
+
+typedef struct DreamLogcatOptions {
+    DreamLogLevel min_level;
+    const char *categories[DREAM_LOGCAT_MAX_FILTERS];
+    int category_count;
+    bool has_thread;
+    uint32_t thread;
+    const char *grep;
+    bool show_date;
+    bool use_color;
+    bool stats;
+} DreamLogcatOptions;
+
+typedef struct DreamLogcatStats {
+    uint64_t records;
+    uint64_t printed;
+    uint64_t preformatted;
+    uint64_t payload_bytes;
+} DreamLogcatStats;
+
+static const char *dream_logcat_level_names[] = {
+    [DREAM_LOG_TRACE]    = "TRACE",
+    [DREAM_LOG_INFO]     = "INFO ",
+    [DREAM_LOG_DEBUG]    = "DEBUG",
+    [DREAM_LOG_WARNING]  = "WARN ",
+    [DREAM_LOG_CRITICAL] = "CRIT ",
+    [DREAM_LOG_FATAL]    = "FATAL",
+};
+
+static const char *dream_logcat_level_colors[] = {
+    [DREAM_LOG_TRACE]    = "\033[90m",
+    [DREAM_LOG_INFO]     = "\033[32m",
+    [DREAM_LOG_DEBUG]    = "\033[36m",
+    [DREAM_LOG_WARNING]  = "\033[33m",
+    [DREAM_LOG_CRITICAL] = "\033[31m",
+    [DREAM_LOG_FATAL]    = "\033[1;31m",
+};
+
+static void dream_logcat_usage(FILE *out) {
+    fprintf(
+        out,
+        "usage: dream-logcat [options] <file | ring file>\n"
+        "  -l <level>     minimum level: trace info debug warn critical "
+        "fatal\n"
+        "  -c <category>  only this category (repeatable)\n"
+        "  -t <thread>    only this thread id\n"
+        "  -g <text>      only messages containing text\n"
+        "  -d             print the date too\n"
+        "  -C             color by level\n"
+        "  -s             print statistics at the end\n"
+    );
+}
+
+static bool dream_logcat_parse_level(const char *name, DreamLogLevel *level) {
+    static const struct {
+        const char *name;
+        DreamLogLevel level;
+    } levels[] = {
+        {"trace", DREAM_LOG_TRACE},
+        {"info", DREAM_LOG_INFO},
+        {"debug", DREAM_LOG_DEBUG},
+        {"warn", DREAM_LOG_WARNING},
+        {"critical", DREAM_LOG_CRITICAL},
+        {"fatal", DREAM_LOG_FATAL},
+    };
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+        if (strcmp(name, levels[i].name) == 0) {
+            *level = levels[i].level;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool dream_logcat_define(
+    DreamLogcatDict *dict, uint64_t id, const uint8_t *data, size_t len
+) {
+    if (id >= dict->capacity) {
+        size_t capacity = dict->capacity ? dict->capacity : 64;
+        while (capacity <= id) capacity *= 2;
+        DreamLogcatString *entries =
+            realloc(dict->entries, capacity * sizeof(*entries));
+        if (!entries) return false;
+        memset(
+            entries + dict->capacity,
+            0,
+            (capacity - dict->capacity) * sizeof(*entries)
+        );
+        dict->entries  = entries;
+        dict->capacity = capacity;
+    }
+
+    char *copy = malloc(len + 1);
+    if (!copy) return false;
+    memcpy(copy, data, len);
+    copy[len] = '\0';
+
+    if (!dict->entries[id].data) ++dict->count;
+    free(dict->entries[id].data);
+    dict->entries[id] = (DreamLogcatString){copy, len};
+    return true;
+}
+
+static const char *
+dream_logcat_lookup(const DreamLogcatDict *dict, uint64_t id) {
+    if (id >= dict->capacity || !dict->entries[id].data) return nullptr;
+    return dict->entries[id].data;
+}
+
+static void dream_logcat_free(DreamLogcatDict *dict) {
+    for (size_t i = 0; i < dict->capacity; ++i) free(dict->entries[i].data);
+    free(dict->entries);
+}
+
+static bool dream_logcat_wants(
+    const DreamLogcatOptions *opt,
+    DreamLogLevel level,
+    const char *category,
+    uint32_t thread
+) {
+    if (level < opt->min_level) return false;
+    if (opt->has_thread && thread != opt->thread) return false;
+    if (opt->category_count == 0) return true;
+    for (int i = 0; i < opt->category_count; ++i)
+        if (strcmp(category, opt->categories[i]) == 0) return true;
+    return false;
+}
+
+static void dream_logcat_print(
+    const DreamLogcatOptions *opt,
+    DreamLogLevel level,
+    const char *category,
+    uint32_t thread,
+    uint64_t wall_ns,
+    const char *message
+) {
+    time_t sec = (time_t)(wall_ns / 1000000000u);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+
+    char stamp[32];
+    const char *layout = opt->show_date ? "%Y-%m-%d %H:%M:%S" : "%H:%M:%S";
+    strftime(stamp, sizeof(stamp), layout, &tm);
+
+    bool known = level >= DREAM_LOG_TRACE && level <= DREAM_LOG_FATAL;
+    printf(
+        "%s[%s.%03u] [%s] [%s] [T:%u] %s%s\n",
+        opt->use_color && known ? dream_logcat_level_colors[level] : "",
+        stamp,
+        (unsigned)((wall_ns / 1000000u) % 1000u),
+        known ? dream_logcat_level_names[level] : "?????",
+        category,
+        thread,
+        message,
+        opt->use_color ? "\033[0m" : ""
+    );
+}
+
+typedef enum DreamLogcatRead {
+    DREAM_LOGCAT_READ_OK,
+    DREAM_LOGCAT_READ_TRUNCATED,
+    DREAM_LOGCAT_READ_BAD_TAG,
+} DreamLogcatRead;
+
+typedef struct DreamLogcatEntry {
+    uint8_t tag;
+    uint8_t level;
+    // FORMAT/CATEGORY: id, length
+    // RECORD: category, format, time delta, thread, payload length
+    uint64_t fields[5];
+    const uint8_t *body;
+    size_t len;
+} DreamLogcatEntry;
+
+static DreamLogcatRead dream_logcat_next(
+    const uint8_t *data, size_t size, size_t *pos, DreamLogcatEntry *e
+) {
+    size_t p = *pos;
+    e->tag   = data[p++];
+    e->level = 0;
+
+    size_t count = 2;
+    if (e->tag == DREAM_LOG_BINARY_RECORD) {
+        if (p >= size) return DREAM_LOGCAT_READ_TRUNCATED;
+        e->level = data[p++];
+        count    = 5;
+    } else if (e->tag != DREAM_LOG_BINARY_FORMAT &&
+               e->tag != DREAM_LOG_BINARY_CATEGORY) {
+        return DREAM_LOGCAT_READ_BAD_TAG;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t n = _dream_log_get_varint(data + p, size - p, &e->fields[i]);
+        if (!n) return DREAM_LOGCAT_READ_TRUNCATED;
+        p += n;
+    }
+    if (e->fields[count - 1] > size - p) return DREAM_LOGCAT_READ_TRUNCATED;
+    e->len  = (size_t)e->fields[count - 1];
+    e->body = data + p;
+    *pos    = p + e->len;
+    return DREAM_LOGCAT_READ_OK;
+}
+
+static void dream_logcat_flight_line(const char *text, size_t len, void *user) {
+    const DreamLogcatOptions *opt = user;
+    if (opt->grep && !strstr(text, opt->grep)) return;
+    fwrite(text, 1, len, stdout);
+}
+
+// Flight recorder rings hold finished text lines; only -g applies.
+static int dream_logcat_flight(
+    const uint8_t *data, size_t size, const DreamLogcatOptions *opt
+) {
+    long lines = _dream_log_flight_read(
+        data, size, dream_logcat_flight_line, (void *)opt
+    );
+    if (lines < 0) {
+        fprintf(stderr, "dream-logcat: damaged flight recorder ring\n");
+        return 1;
+    }
+    if (opt->stats) {
+        const DreamLogFlightHeader *header = (const void *)data;
+        fprintf(
+            stderr,
+            "pid %u, %ld of %u lines complete\n",
+            header->pid,
+            lines,
+            header->slot_count
+        );
+    }
+    return 0;
+}
+
+static int dream_logcat_decode(
+    const uint8_t *data, size_t size, const DreamLogcatOptions *opt
+) {
+    DreamLogBinaryHeader header = _dream_log_binary_header();
+    DreamLogBinaryHeader file_header;
+    if (size < sizeof(file_header)) {
+        fprintf(stderr, "dream-logcat: file too short for a header\n");
+        return 1;
+    }
+    memcpy(&file_header, data, sizeof(file_header));
+    if (memcmp(file_header.magic, header.magic, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "dream-logcat: not a Dream binary log\n");
+        return 1;
+    }
+    if (file_header.version != header.version) {
+        fprintf(
+            stderr,
+            "dream-logcat: unsupported version %u\n",
+            file_header.version
+        );
+        return 1;
+    }
+    // Packed arguments are raw native values.
+    bool same_abi = memcmp(&file_header, &header, sizeof(header)) == 0;
+    if (!same_abi)
+        fprintf(
+            stderr,
+            "dream-logcat: written with other type sizes or byte order, "
+            "showing format strings only\n"
+        );
+
+    DreamLogcatDict formats    = {0};
+    DreamLogcatDict categories = {0};
+    DreamLogcatStats stats     = {0};
+    char message[DREAM_LOGCAT_MAX_MESSAGE];
+    uint64_t wall_ns = 0;
+    int result       = 0;
+
+    size_t pos = sizeof(header);
+    while (pos < size) {
+        DreamLogcatEntry e;
+        size_t start         = pos;
+        DreamLogcatRead read = dream_logcat_next(data, size, &pos, &e);
+        if (read == DREAM_LOGCAT_READ_TRUNCATED) {
+            // A log still being written, or cut short by a crash.
+            fprintf(stderr, "dream-logcat: truncated entry at end of file\n");
+            break;
+        }
+        if (read == DREAM_LOGCAT_READ_BAD_TAG) {
+            fprintf(
+                stderr,
+                "dream-logcat: bad entry tag %u at offset %zu\n",
+                e.tag,
+                pos
+            );
+            result = 1;
+            break;
+        }
+
+        if (e.tag != DREAM_LOG_BINARY_RECORD) {
+            DreamLogcatDict *dict =
+                e.tag == DREAM_LOG_BINARY_FORMAT ? &formats : &categories;
+            // Category ids index the writer's fixed table. Format ids count
+            // up from 1 and every definition takes at least three bytes, so
+            // no intact file holds one above its own size.
+            uint64_t id_limit = e.tag == DREAM_LOG_BINARY_FORMAT
+                ? size
+                : DREAM_LOG_MAX_CATEGORIES;
+            if (e.fields[0] >= id_limit) {
+                fprintf(
+                    stderr,
+                    "dream-logcat: bad dictionary id %llu at offset %zu\n",
+                    (unsigned long long)e.fields[0],
+                    start
+                );
+                result = 1;
+                break;
+            }
+            if (!dream_logcat_define(dict, e.fields[0], e.body, e.len)) {
+                fprintf(stderr, "dream-logcat: out of memory\n");
+                result = 1;
+                break;
+            }
+            continue;
+        }
+
+        wall_ns += (uint64_t)_dream_log_unzigzag(e.fields[2]);
+        ++stats.records;
+        stats.payload_bytes += e.len;
+
+        DreamLogLevel level  = (DreamLogLevel)e.level;
+        const char *category = dream_logcat_lookup(&categories, e.fields[0]);
+        if (!category) category = "?";
+        uint32_t thread = (uint32_t)e.fields[3];
+        if (!dream_logcat_wants(opt, level, category, thread)) continue;
+
+        uint64_t format = e.fields[1];
+        const char *fmt = dream_logcat_lookup(&formats, format);
+        if (format == 0) {
+            ++stats.preformatted;
+            size_t n = e.len < sizeof(message) ? e.len : sizeof(message) - 1;
+            memcpy(message, e.body, n);
+            message[n] = '\0';
+        } else if (!fmt) {
+            snprintf(
+                message,
+                sizeof(message),
+                "<undefined format %llu>",
+                (unsigned long long)format
+            );
+        } else if (!same_abi) {
+            snprintf(message, sizeof(message), "%s", fmt);
+        } else {
+            _dream_log_format_packed(
+                fmt, (const char *)e.body, e.len, message, sizeof(message)
+            );
+        }
+
+        if (opt->grep && !strstr(message, opt->grep)) continue;
+        ++stats.printed;
+        dream_logcat_print(opt, level, category, thread, wall_ns, message);
+    }
+
+    if (opt->stats)
+        fprintf(
+            stderr,
+            "records: %llu, printed: %llu, formats: %zu, categories: %zu, "
+            "preformatted: %llu, payload bytes: %llu, file bytes: %zu\n",
+            (unsigned long long)stats.records,
+            (unsigned long long)stats.printed,
+            formats.count,
+            categories.count,
+            (unsigned long long)stats.preformatted,
+            (unsigned long long)stats.payload_bytes,
+            size
+        );
+
+    dream_logcat_free(&formats);
+    dream_logcat_free(&categories);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    DreamLogcatOptions opt = {.min_level = DREAM_LOG_TRACE};
+
+    int c;
+    while ((c = getopt(argc, argv, "l:c:t:g:dCsh")) != -1) {
+        switch (c) {
+            case 'l':
+                if (!dream_logcat_parse_level(optarg, &opt.min_level)) {
+                    fprintf(stderr, "dream-logcat: unknown level %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'c':
+                if (opt.category_count == DREAM_LOGCAT_MAX_FILTERS) {
+                    fprintf(stderr, "dream-logcat: too many -c filters\n");
+                    return 2;
+                }
+                opt.categories[opt.category_count++] = optarg;
+                break;
+            case 't':
+                opt.has_thread = true;
+                opt.thread     = (uint32_t)strtoul(optarg, nullptr, 0);
+                break;
+            case 'g': opt.grep = optarg; break;
+            case 'd': opt.show_date = true; break;
+            case 'C': opt.use_color = true; break;
+            case 's': opt.stats = true; break;
+            case 'h': dream_logcat_usage(stdout); return 0;
+            default:  dream_logcat_usage(stderr); return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        dream_logcat_usage(stderr);
+        return 2;
+    }
+
+    const char *path = argv[optind];
+    int fd           = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return 1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        fprintf(stderr, "dream-logcat: %s is empty\n", path);
+        return 1;
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    int result = size >= sizeof(DREAM_LOG_FLIGHT_MAGIC) &&
+                         memcmp(
+                             data,
+                             DREAM_LOG_FLIGHT_MAGIC,
+                             sizeof(DREAM_LOG_FLIGHT_MAGIC)
+                         ) == 0
+        ? dream_logcat_flight(data, size, &opt)
+        : dream_logcat_decode(data, size, &opt);
+    munmap(data, size);
+    return result;
+}
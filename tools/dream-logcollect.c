@@ -0,0 +1,470 @@
+// dream-logcollect: attaches to the shared-memory rings of processes logging
+// through DREAM_LOG_SINK_SHM, merges their records by timestamp and writes
+// them out as text lines. The ring layout is described in LogFormat.h.
+
+#include <Dream/Dream.h>
+
+#include "LogFormat.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DREAM_LOGCOLLECT_MAX_RINGS 256
+#define DREAM_LOGCOLLECT_SHM_DIR "/dev/shm"
+#define DREAM_LOGCOLLECT_PULL_EVERY 256
+
+typedef struct DreamLogcollectRing {
+    char name[NAME_MAX + 2]; // with the leading '/'
+    DreamLogShmHeader *header;
+    size_t size;
+    uint32_t pid;
+    uint64_t dropped; // last count reported
+    bool gone;        // closed, or its process died without closing it
+    // Records copied out of the ring, so that holding them back for the
+    // merge does not leave the writer without room.
+    char *pending;
+    size_t pending_start;
+    size_t pending_end;
+    size_t pending_capacity;
+} DreamLogcollectRing;
+
+typedef struct DreamLogcollectOptions {
+    FILE *out;
+    uint64_t window_ns;
+    uint64_t scan_interval_ns;
+    bool scan; // no names given: pick up every ring in /dev/shm
+    bool exit_when_done;
+    bool show_date;
+    bool use_color;
+} DreamLogcollectOptions;
+
+typedef struct DreamLogcollectState {
+    DreamLogcollectRing rings[DREAM_LOGCOLLECT_MAX_RINGS];
+    int ring_count;
+    int attached; // rings seen so far
+    uint64_t records;
+} DreamLogcollectState;
+
+static volatile sig_atomic_t g_dream_logcollect_stop;
+
+static const char *dream_logcollect_level_names[] = {
+    [DREAM_LOG_TRACE]    = "TRACE",
+    [DREAM_LOG_INFO]     = "INFO ",
+    [DREAM_LOG_DEBUG]    = "DEBUG",
+    [DREAM_LOG_WARNING]  = "WARN ",
+    [DREAM_LOG_CRITICAL] = "CRIT ",
+    [DREAM_LOG_FATAL]    = "FATAL",
+};
+
+static const char *dream_logcollect_level_colors[] = {
+    [DREAM_LOG_TRACE]    = "\033[90m",
+    [DREAM_LOG_INFO]     = "\033[32m",
+    [DREAM_LOG_DEBUG]    = "\033[36m",
+    [DREAM_LOG_WARNING]  = "\033[33m",
+    [DREAM_LOG_CRITICAL] = "\033[31m",
+    [DREAM_LOG_FATAL]    = "\033[1;31m",
+};
+
+static void dream_logcollect_usage(FILE *out) {
+    fprintf(
+        out,
+        "usage: dream-logcollect [options] [shm name ...]\n"
+        "  Without names, every /" DREAM_LOG_SHM_PREFIX "* ring is "
+        "collected as it appears.\n"
+        "  -o <file>  append to file instead of stdout\n"
+        "  -w <ms>    hold records up to this long to merge processes in "
+        "time order (50)\n"
+        "  -i <ms>    how often to look for new rings (200)\n"
+        "  -x         exit once the rings seen are closed and drained\n"
+        "  -d         print the date too\n"
+        "  -C         color by level\n"
+    );
+}
+
+static void dream_logcollect_on_signal(int sig) {
+    (void)sig;
+    g_dream_logcollect_stop = 1;
+}
+
+static uint64_t dream_logcollect_now_ns(int clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool
+dream_logcollect_attached(const DreamLogcollectState *st, const char *name) {
+    for (int i = 0; i < st->ring_count; ++i)
+        if (strcmp(st->rings[i].name, name) == 0) return true;
+    return false;
+}
+
+static bool
+dream_logcollect_attach(DreamLogcollectState *st, const char *name) {
+    if (st->ring_count == DREAM_LOGCOLLECT_MAX_RINGS) {
+        fprintf(
+            stderr, "dream-logcollect: too many rings, skipping %s\n", name
+        );
+        return false;
+    }
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    struct stat sb;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 &&
+        (size_t)sb.st_size >= sizeof(DreamLogShmHeader))
+        map = mmap(
+            nullptr,
+            (size_t)sb.st_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            fd,
+            0
+        );
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    // The writer fills the header in right after creating the object.
+    DreamLogShmHeader *header = map;
+    atomic_thread_fence(memory_order_acquire);
+    if (memcmp(header->magic, DREAM_LOG_SHM_MAGIC, sizeof(header->magic)) !=
+            0 ||
+        header->version != DREAM_LOG_SHM_VERSION ||
+        header->header_size + header->capacity != (uint64_t)sb.st_size ||
+        (header->capacity & (header->capacity - 1))) {
+        munmap(map, (size_t)sb.st_size);
+        return false;
+    }
+
+    DreamLogcollectRing *r = &st->rings[st->ring_count++];
+    *r = (DreamLogcollectRing){
+        .header = header,
+        .size   = (size_t)sb.st_size,
+        .pid    = header->pid,
+    };
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    ++st->attached;
+    return true;
+}
+
+static void dream_logcollect_scan(DreamLogcollectState *st) {
+    DIR *dir = opendir(DREAM_LOGCOLLECT_SHM_DIR);
+    if (!dir) return;
+    struct dirent *entry;
+    char name[NAME_MAX + 2];
+    while ((entry = readdir(dir))) {
+        if (strncmp(
+                entry->d_name,
+                DREAM_LOG_SHM_PREFIX,
+                sizeof(DREAM_LOG_SHM_PREFIX) - 1
+            ) != 0)
+            continue;
+        snprintf(name, sizeof(name), "/%s", entry->d_name);
+        if (!dream_logcollect_attached(st, name))
+            dream_logcollect_attach(st, name);
+    }
+    closedir(dir);
+}
+
+static bool dream_logcollect_reserve(DreamLogcollectRing *r, size_t n) {
+    if (r->pending_start == r->pending_end)
+        r->pending_start = r->pending_end = 0;
+    if (r->pending_end + n <= r->pending_capacity) return true;
+
+    size_t used = r->pending_end - r->pending_start;
+    if (used) memmove(r->pending, r->pending + r->pending_start, used);
+    r->pending_start = 0;
+    r->pending_end   = used;
+    if (used + n <= r->pending_capacity) return true;
+
+    size_t capacity = r->pending_capacity ? r->pending_capacity : 64 * 1024;
+    while (capacity < used + n) capacity *= 2;
+    char *pending = realloc(r->pending, capacity);
+    if (!pending) return false;
+    r->pending          = pending;
+    r->pending_capacity = capacity;
+    return true;
+}
+
+// Whether the record at `head` lies within what was published and within
+// the ring, as the writer lays records out. The ring is writable by any
+// process of the user, so nothing in it is trusted.
+static bool dream_logcollect_valid(
+    const DreamLogShmHeader *h,
+    const DreamLogShmRecord *rec,
+    uint64_t head,
+    uint64_t tail
+) {
+    uint64_t size   = rec->size;
+    uint64_t to_end = h->capacity - (head & (h->capacity - 1));
+    if (!size || size % 8 || size > tail - head || size > to_end) return false;
+    if (rec->kind == DREAM_LOG_SHM_PAD) return true;
+    return rec->kind == DREAM_LOG_SHM_RECORD &&
+           size >= sizeof(DreamLogShmRecord) &&
+           (uint64_t)rec->category_len + rec->message_len <=
+               size - sizeof(DreamLogShmRecord);
+}
+
+// Moves everything published in the ring to the pending records. A ring
+// holding a record that does not add up is skipped to its tail.
+static void dream_logcollect_pull(DreamLogcollectRing *r) {
+    DreamLogShmHeader *h = r->header;
+    uint64_t head = atomic_load_explicit(&h->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&h->tail, memory_order_acquire);
+    if (tail - head > h->capacity) {
+        fprintf(
+            stderr,
+            "dream-logcollect: %s: positions out of range, skipping to tail\n",
+            r->name
+        );
+        head = tail;
+    }
+    while (head != tail) {
+        const DreamLogShmRecord *rec = _dream_log_shm_record(h, head);
+        if (!dream_logcollect_valid(h, rec, head, tail)) {
+            fprintf(
+                stderr,
+                "dream-logcollect: %s: corrupt record at %llu, skipping to "
+                "tail\n",
+                r->name,
+                (unsigned long long)head
+            );
+            head = tail;
+            break;
+        }
+        if (rec->kind != DREAM_LOG_SHM_PAD) {
+            if (!dream_logcollect_reserve(r, rec->size)) break;
+            memcpy(r->pending + r->pending_end, rec, rec->size);
+            r->pending_end += rec->size;
+        }
+        head += rec->size;
+    }
+    atomic_store_explicit(&h->head, head, memory_order_release);
+}
+
+static const DreamLogShmRecord *
+dream_logcollect_peek(const DreamLogcollectRing *r) {
+    if (r->pending_start == r->pending_end) return nullptr;
+    return (const DreamLogShmRecord *)(r->pending + r->pending_start);
+}
+
+static void dream_logcollect_consume(
+    DreamLogcollectRing *r, const DreamLogShmRecord *rec
+) {
+    r->pending_start += rec->size;
+}
+
+static void dream_logcollect_print(
+    const DreamLogcollectOptions *opt,
+    const DreamLogcollectRing *r,
+    const DreamLogShmRecord *rec
+) {
+    // localtime_r is slow next to the rest, and most records share a
+    // second with the one before.
+    static time_t stamp_sec = -1;
+    static char stamp[32];
+    time_t sec = (time_t)(rec->wall_ns / 1000000000u);
+    if (sec != stamp_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        const char *layout =
+            opt->show_date ? "%Y-%m-%d %H:%M:%S" : "%H:%M:%S";
+        strftime(stamp, sizeof(stamp), layout, &tm);
+        stamp_sec = sec;
+    }
+
+    bool known = rec->level <= DREAM_LOG_FATAL;
+    fprintf(
+        opt->out,
+        "%s[%s.%03u] [%s] [%.*s] [P:%u T:%u] %.*s%s\n",
+        opt->use_color && known ? dream_logcollect_level_colors[rec->level]
+                                : "",
+        stamp,
+        (unsigned)((rec->wall_ns / 1000000u) % 1000u),
+        known ? dream_logcollect_level_names[rec->level] : "?????",
+        (int)rec->category_len,
+        rec->text,
+        r->pid,
+        rec->threadid,
+        (int)rec->message_len,
+        rec->text + rec->category_len,
+        opt->use_color ? "\033[0m" : ""
+    );
+}
+
+static void dream_logcollect_report_drops(DreamLogcollectRing *r) {
+    uint64_t dropped =
+        atomic_load_explicit(&r->header->dropped, memory_order_relaxed);
+    if (dropped == r->dropped) return;
+    fprintf(
+        stderr,
+        "dream-logcollect: pid %u dropped %llu records, ring full\n",
+        r->pid,
+        (unsigned long long)(dropped - r->dropped)
+    );
+    r->dropped = dropped;
+}
+
+// Writes records in timestamp order across the rings. A record is only
+// written once every live ring has something newer queued, or once it is
+// older than the window, so a process that logs rarely cannot hold the
+// others up for long. `flush` ignores the window.
+static size_t dream_logcollect_merge(
+    DreamLogcollectState *st, const DreamLogcollectOptions *opt, bool flush
+) {
+    size_t written = 0;
+    uint64_t now   = dream_logcollect_now_ns(CLOCK_REALTIME);
+
+    for (;;) {
+        // Keep the rings empty while writing out a backlog.
+        if (written % DREAM_LOGCOLLECT_PULL_EVERY == 0)
+            for (int i = 0; i < st->ring_count; ++i)
+                dream_logcollect_pull(&st->rings[i]);
+
+        DreamLogcollectRing *oldest         = nullptr;
+        const DreamLogShmRecord *oldest_rec = nullptr;
+        bool waiting                        = false;
+
+        for (int i = 0; i < st->ring_count; ++i) {
+            DreamLogcollectRing *r       = &st->rings[i];
+            const DreamLogShmRecord *rec = dream_logcollect_peek(r);
+            if (!rec) {
+                waiting |= !r->gone;
+                continue;
+            }
+            if (!oldest_rec || rec->wall_ns < oldest_rec->wall_ns) {
+                oldest     = r;
+                oldest_rec = rec;
+            }
+        }
+        if (!oldest) break;
+        if (waiting && !flush && oldest_rec->wall_ns + opt->window_ns > now)
+            break;
+
+        dream_logcollect_print(opt, oldest, oldest_rec);
+        dream_logcollect_consume(oldest, oldest_rec);
+        ++written;
+    }
+
+    st->records += written;
+    return written;
+}
+
+// Marks rings whose writer is done and drops the drained ones. A writer
+// that crashed never sets `closed`, so its pid is checked too.
+static void dream_logcollect_reap(DreamLogcollectState *st) {
+    for (int i = 0; i < st->ring_count;) {
+        DreamLogcollectRing *r = &st->rings[i];
+        dream_logcollect_report_drops(r);
+        if (!r->gone)
+            r->gone = atomic_load_explicit(
+                          &r->header->closed, memory_order_acquire
+                      ) ||
+                      (kill((pid_t)r->pid, 0) != 0 && errno == ESRCH);
+        if (!r->gone || dream_logcollect_peek(r) ||
+            atomic_load_explicit(&r->header->tail, memory_order_acquire) !=
+                atomic_load_explicit(&r->header->head, memory_order_relaxed)) {
+            ++i;
+            continue;
+        }
+
+        shm_unlink(r->name); // unless the writer found it drained
+        munmap(r->header, r->size);
+        free(r->pending);
+        st->rings[i] = st->rings[--st->ring_count];
+    }
+}
+
+int main(int argc, char **argv) {
+    DreamLogcollectOptions opt = {
+        .out              = stdout,
+        .window_ns        = 50 * 1000000ull,
+        .scan_interval_ns = 200 * 1000000ull,
+    };
+
+    int c;
+    while ((c = getopt(argc, argv, "o:w:i:xdCh")) != -1) {
+        switch (c) {
+            case 'o':
+                opt.out = fopen(optarg, "a");
+                if (!opt.out) {
+                    fprintf(
+                        stderr,
+                        "dream-logcollect: cannot open %s: %s\n",
+                        optarg,
+                        strerror(errno)
+                    );
+                    return 1;
+                }
+                break;
+            case 'w':
+                opt.window_ns = strtoull(optarg, nullptr, 0) * 1000000ull;
+                break;
+            case 'i':
+                opt.scan_interval_ns =
+                    strtoull(optarg, nullptr, 0) * 1000000ull;
+                break;
+            case 'x': opt.exit_when_done = true; break;
+            case 'd': opt.show_date = true; break;
+            case 'C': opt.use_color = true; break;
+            case 'h': dream_logcollect_usage(stdout); return 0;
+            default:  dream_logcollect_usage(stderr); return 2;
+        }
+    }
+
+    static DreamLogcollectState st;
+    opt.scan = optind == argc;
+    for (int i = optind; i < argc; ++i) {
+        char name[NAME_MAX + 2];
+        snprintf(
+            name, sizeof(name), "%s%s", argv[i][0] == '/' ? "" : "/", argv[i]
+        );
+        if (!dream_logcollect_attach(&st, name)) {
+            fprintf(stderr, "dream-logcollect: cannot attach to %s\n", name);
+            return 1;
+        }
+    }
+
+    struct sigaction action = {.sa_handler = dream_logcollect_on_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    uint64_t last_scan = 0;
+    while (!g_dream_logcollect_stop) {
+        uint64_t now = dream_logcollect_now_ns(CLOCK_MONOTONIC);
+        if (now - last_scan >= opt.scan_interval_ns) {
+            if (opt.scan) dream_logcollect_scan(&st);
+            dream_logcollect_reap(&st);
+            last_scan = now;
+        }
+
+        if (dream_logcollect_merge(&st, &opt, false)) continue;
+        dream_logcollect_reap(&st);
+        if (opt.exit_when_done && st.attached && st.ring_count == 0) break;
+
+        fflush(opt.out);
+        nanosleep(&(struct timespec){.tv_nsec = 1000000}, nullptr);
+    }
+
+    dream_logcollect_merge(&st, &opt, true);
+    for (int i = 0; i < st.ring_count; ++i) {
+        dream_logcollect_report_drops(&st.rings[i]);
+        munmap(st.rings[i].header, st.rings[i].size);
+        free(st.rings[i].pending);
+    }
+    fflush(opt.out);
+    if (opt.out != stdout) fclose(opt.out);
+    return 0;
+}
@@ -0,0 +1,346 @@
+// DreamLoggerBench: producer-side latency and throughput of the logger,
+// sync and async, across overflow policies, producer counts, message sizes
+// and sinks. Every run appends one CSV row, so two result files can be
+// diffed or plotted to catch regressions in DreamLog and dream_async_push.
+
+#include "Logger.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DREAM_BENCH_MAX_THREADS 64
+
+typedef enum DreamBenchSink {
+    DREAM_BENCH_SINK_CALLBACK,
+    DREAM_BENCH_SINK_STDOUT, // redirected to /dev/null for the run
+    DREAM_BENCH_SINK_FILE,
+    DREAM_BENCH_SINK_BINARY,
+    DREAM_BENCH_SINK_RING,
+    DREAM_BENCH_SINK_COUNT,
+} DreamBenchSink;
+
+static const char *dream_bench_sink_names[] = {
+    [DREAM_BENCH_SINK_CALLBACK] = "callback",
+    [DREAM_BENCH_SINK_STDOUT]   = "stdout",
+    [DREAM_BENCH_SINK_FILE]     = "file",
+    [DREAM_BENCH_SINK_BINARY]   = "binary",
+    [DREAM_BENCH_SINK_RING]     = "ring",
+};
+
+static const char *dream_bench_policy_names[] = {
+    [BLOCK]       = "block",
+    [DROP_OLDEST] = "drop_oldest",
+    [DROP_NEWEST] = "drop_newest",
+};
+
+static const uint32_t dream_bench_sizes[] = {16, 128, 512};
+#define DREAM_BENCH_SIZE_COUNT \
+    (sizeof(dream_bench_sizes) / sizeof(dream_bench_sizes[0]))
+
+typedef struct DreamBenchOptions {
+    uint32_t max_threads;
+    uint32_t messages; // per producer
+    size_t queue_bytes;
+    const char *output;
+    const char *dir;
+    const char *only_mode; // "sync", "async" or null for both
+    const char *only_sink;
+    const char *only_policy;
+} DreamBenchOptions;
+
+typedef struct DreamBenchRun {
+    bool async;
+    DreamLogAsyncOverflowPolicy policy;
+    DreamBenchSink sink;
+    uint32_t threads;
+    uint32_t payload_bytes;
+} DreamBenchRun;
+
+typedef struct DreamBenchProducer {
+    thrd_t thread;
+    uint32_t messages;
+    const char *payload;
+    uint64_t *samples; // ns per call
+    atomic_bool *start;
+} DreamBenchProducer;
+
+static uint64_t dream_bench_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void dream_bench_callback(
+    DreamLogLevel level,
+    const char *category,
+    const char *message,
+    const char *formatted_line,
+    void *user_data
+) {}
+
+static int dream_bench_producer(void *arg) {
+    DreamBenchProducer *p = arg;
+    while (!atomic_load_explicit(p->start, memory_order_acquire))
+        thrd_yield();
+
+    for (uint32_t i = 0; i < p->messages; ++i) {
+        uint64_t before = dream_bench_ns();
+        dInfo("Bench", "seq=%u %s", i, p->payload);
+        p->samples[i] = dream_bench_ns() - before;
+    }
+    return 0;
+}
+
+static int dream_bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t
+dream_bench_percentile(const uint64_t *sorted, size_t count, double pct) {
+    size_t index = (size_t)(pct / 100.0 * (double)(count - 1) + 0.5);
+    return sorted[index];
+}
+
+static bool dream_bench_run(
+    const DreamBenchOptions *opt, const DreamBenchRun *run, FILE *csv
+) {
+    char log_path[512];
+    char binary_path[512];
+    snprintf(log_path, sizeof(log_path), "%s/dream-bench.log", opt->dir);
+    snprintf(binary_path, sizeof(binary_path), "%s/dream-bench.dlog", opt->dir);
+
+    static const DreamLoggerSinkTo sink_types[] = {
+        [DREAM_BENCH_SINK_CALLBACK] = DREAM_LOG_SINK_CALLBACK,
+        [DREAM_BENCH_SINK_STDOUT]   = DREAM_LOG_SINK_STDOUT,
+        [DREAM_BENCH_SINK_FILE]     = DREAM_LOG_SINK_FILE,
+        [DREAM_BENCH_SINK_BINARY]   = DREAM_LOG_SINK_BINARY,
+        [DREAM_BENCH_SINK_RING]     = DREAM_LOG_SINK_RING_BUFFER,
+    };
+    DreamLoggerSink sink = {
+        .sink_into = sink_types[run->sink],
+        .min_level = DREAM_LOG_TRACE,
+    };
+    DreamLoggerSink *sinks[] = {&sink};
+    DreamLoggerConfig config = {
+        .enabled                   = true,
+        .show_time                 = true,
+        .show_thread               = true,
+        .global_min_log_level      = DREAM_LOG_TRACE,
+        .sinks                     = sinks,
+        .sink_count                = 1,
+        .logfile_path              = log_path,
+        .binary_logfile_path       = binary_path,
+        .ring_buffer_lines         = 4096,
+        .ring_buffer_line_len      = 1200,
+        .callback                  = dream_bench_callback,
+        .async                     = run->async,
+        .async_queue_bytes         = opt->queue_bytes,
+        .async_log_overflow_policy = run->policy,
+        .async_deferred_format     = true,
+    };
+
+    size_t total = (size_t)run->threads * opt->messages;
+    uint64_t *samples = malloc(total * sizeof(uint64_t));
+    char *payload     = malloc(run->payload_bytes + 1);
+    if (!samples || !payload) {
+        free(samples);
+        free(payload);
+        return false;
+    }
+    memset(payload, 'x', run->payload_bytes);
+    payload[run->payload_bytes] = '\0';
+
+    int saved_stdout = -1;
+    if (run->sink == DREAM_BENCH_SINK_STDOUT) {
+        fflush(stdout);
+        saved_stdout = dup(STDOUT_FILENO);
+        int null_fd  = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+
+    DreamLoggerInit(&config);
+
+    atomic_bool start = false;
+    DreamBenchProducer producers[DREAM_BENCH_MAX_THREADS];
+    for (uint32_t t = 0; t < run->threads; ++t) {
+        producers[t] = (DreamBenchProducer){
+            .messages = opt->messages,
+            .payload  = payload,
+            .samples  = samples + (size_t)t * opt->messages,
+            .start    = &start,
+        };
+        thrd_create(&producers[t].thread, dream_bench_producer, &producers[t]);
+    }
+
+    uint64_t begin = dream_bench_ns();
+    atomic_store_explicit(&start, true, memory_order_release);
+    for (uint32_t t = 0; t < run->threads; ++t)
+        thrd_join(producers[t].thread, nullptr);
+    uint64_t produced = dream_bench_ns();
+
+    DreamLoggerStats stats;
+    DreamLoggerGetStats(&stats);
+    DreamLoggerShutdown(); // waits for the worker to drain everything
+    uint64_t drained = dream_bench_ns();
+
+    if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+    unlink(log_path);
+    unlink(binary_path);
+
+    qsort(samples, total, sizeof(uint64_t), dream_bench_compare);
+    double produce_s = (double)(produced - begin) / 1e9;
+    double drain_s   = (double)(drained - begin) / 1e9;
+    fprintf(
+        csv,
+        "%s,%s,%s,%u,%u,%zu,%.6f,%.0f,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,"
+        "%llu,%llu\n",
+        run->async ? "async" : "sync",
+        run->async ? dream_bench_policy_names[run->policy] : "-",
+        dream_bench_sink_names[run->sink],
+        run->threads,
+        run->payload_bytes,
+        total,
+        produce_s,
+        (double)total / produce_s,
+        (double)total / drain_s,
+        (unsigned long long)dream_bench_percentile(samples, total, 50),
+        (unsigned long long)dream_bench_percentile(samples, total, 90),
+        (unsigned long long)dream_bench_percentile(samples, total, 99),
+        (unsigned long long)dream_bench_percentile(samples, total, 99.9),
+        (unsigned long long)samples[total - 1],
+        (unsigned long long)(stats.dropped_newest + stats.dropped_oldest),
+        (unsigned long long)stats.blocked_ns,
+        (unsigned long long)DreamLoggerLatencyPercentile(&stats, 99)
+    );
+    fflush(csv);
+    fprintf(
+        stderr,
+        "%-5s %-11s %-8s %2u threads %4u B: %9.0f msg/s, p50 %llu ns, "
+        "p99 %llu ns\n",
+        run->async ? "async" : "sync",
+        run->async ? dream_bench_policy_names[run->policy] : "-",
+        dream_bench_sink_names[run->sink],
+        run->threads,
+        run->payload_bytes,
+        (double)total / produce_s,
+        (unsigned long long)dream_bench_percentile(samples, total, 50),
+        (unsigned long long)dream_bench_percentile(samples, total, 99)
+    );
+
+    free(samples);
+    free(payload);
+    return true;
+}
+
+// Every sink, producer count and message size for one mode and policy.
+static bool dream_bench_sweep(
+    const DreamBenchOptions *opt,
+    bool async,
+    DreamLogAsyncOverflowPolicy policy,
+    FILE *csv
+) {
+    for (int sink = 0; sink < DREAM_BENCH_SINK_COUNT; ++sink) {
+        if (opt->only_sink &&
+            strcmp(opt->only_sink, dream_bench_sink_names[sink]) != 0)
+            continue;
+        for (uint32_t threads = 1; threads <= opt->max_threads; threads *= 2) {
+            for (size_t s = 0; s < DREAM_BENCH_SIZE_COUNT; ++s) {
+                DreamBenchRun run = {
+                    .async         = async,
+                    .policy        = policy,
+                    .sink          = (DreamBenchSink)sink,
+                    .threads       = threads,
+                    .payload_bytes = dream_bench_sizes[s],
+                };
+                if (!dream_bench_run(opt, &run, csv)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void dream_bench_usage(FILE *out) {
+    fprintf(
+        out,
+        "usage: DreamLoggerBench [options]\n"
+        "  -t <n>       up to n producer threads, doubling from 1 (default 8)\n"
+        "  -n <n>       messages per producer (default 100000)\n"
+        "  -q <bytes>   async queue size (default 1 MiB)\n"
+        "  -o <file>    CSV results (default dream-logger-bench.csv)\n"
+        "  -d <dir>     directory for file sink output (default /tmp)\n"
+        "  -m <mode>    only sync or async\n"
+        "  -s <sink>    only callback, stdout, file, binary or ring\n"
+        "  -p <policy>  only block, drop_oldest or drop_newest\n"
+    );
+}
+
+int main(int argc, char **argv) {
+    DreamBenchOptions opt = {
+        .max_threads = 8,
+        .messages    = 100000,
+        .queue_bytes = 1 << 20,
+        .output      = "dream-logger-bench.csv",
+        .dir         = "/tmp",
+    };
+
+    int c;
+    while ((c = getopt(argc, argv, "t:n:q:o:d:m:s:p:h")) != -1) {
+        switch (c) {
+            case 't': opt.max_threads = (uint32_t)atoi(optarg); break;
+            case 'n': opt.messages = (uint32_t)atoi(optarg); break;
+            case 'q': opt.queue_bytes = (size_t)atoll(optarg); break;
+            case 'o': opt.output = optarg; break;
+            case 'd': opt.dir = optarg; break;
+            case 'm': opt.only_mode = optarg; break;
+            case 's': opt.only_sink = optarg; break;
+            case 'p': opt.only_policy = optarg; break;
+            case 'h': dream_bench_usage(stdout); return 0;
+            default:  dream_bench_usage(stderr); return 2;
+        }
+    }
+    if (opt.max_threads < 1 || opt.max_threads > DREAM_BENCH_MAX_THREADS ||
+        opt.messages < 1) {
+        dream_bench_usage(stderr);
+        return 2;
+    }
+
+    FILE *csv = fopen(opt.output, "w");
+    if (!csv) {
+        perror(opt.output);
+        return 1;
+    }
+    fprintf(
+        csv,
+        "mode,policy,sink,threads,payload_bytes,messages,produce_s,"
+        "produce_msgs_per_s,drain_msgs_per_s,call_p50_ns,call_p90_ns,"
+        "call_p99_ns,call_p999_ns,call_max_ns,dropped,blocked_ns,"
+        "enqueue_to_sink_p99_ns\n"
+    );
+
+    bool ok = true;
+    if (!opt.only_mode || strcmp(opt.only_mode, "sync") == 0)
+        ok = dream_bench_sweep(&opt, false, BLOCK, csv); // no queue, no policy
+    for (int policy = BLOCK; ok && policy <= DROP_NEWEST; ++policy) {
+        if (opt.only_mode && strcmp(opt.only_mode, "async") != 0) break;
+        if (opt.only_policy &&
+            strcmp(opt.only_policy, dream_bench_policy_names[policy]) != 0)
+            continue;
+        ok = dream_bench_sweep(&opt, true, policy, csv);
+    }
+
+    fclose(csv);
+    if (!ok) fprintf(stderr, "DreamLoggerBench: out of memory\n");
+    return ok ? 0 : 1;
+}
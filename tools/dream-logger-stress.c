@@ -0,0 +1,207 @@
+// DreamLoggerStress: integrity of the async queues under contention. 16
+// producers log sequence-tagged lines of varying length through every
+// overflow policy, with eager and deferred formatting, on the shared queue
+// and on per-thread queues. A callback sink checks every line it is given:
+// the payload must be whole, and each producer's sequence numbers must
+// arrive once and in order. BLOCK must deliver all of them. Exits non-zero
+// on the first run that fails.
+
+#include "Logger.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#define DREAM_STRESS_THREADS 16
+#define DREAM_STRESS_MAX_PAYLOAD 600
+
+static const char *dream_stress_policy_names[] = {
+    [BLOCK]       = "block",
+    [DROP_OLDEST] = "drop_oldest",
+    [DROP_NEWEST] = "drop_newest",
+};
+
+typedef struct DreamStressRun {
+    DreamLogAsyncOverflowPolicy policy;
+    bool deferred;
+    bool per_thread;
+} DreamStressRun;
+
+// Written by the callback only, which the worker calls; read after
+// DreamLoggerShutdown has joined it.
+typedef struct DreamStressCheck {
+    uint32_t next[DREAM_STRESS_THREADS]; // lowest sequence number still due
+    uint64_t received;
+    uint64_t torn;
+    uint64_t duplicated; // or out of order
+    uint64_t foreign;    // lines the producers did not log
+} DreamStressCheck;
+
+typedef struct DreamStressProducer {
+    thrd_t thread;
+    uint32_t id;
+    uint32_t messages;
+    atomic_bool *start;
+} DreamStressProducer;
+
+// Length and fill of a producer's line, both derived from its sequence
+// number so the sink can tell a torn line from a whole one.
+static uint32_t dream_stress_length(uint32_t id, uint32_t seq) {
+    uint32_t x = (id + 1) * 2654435761u ^ seq * 2246822519u;
+    x ^= x >> 15;
+    return x % (DREAM_STRESS_MAX_PAYLOAD + 1);
+}
+
+static char dream_stress_fill(uint32_t id, uint32_t seq) {
+    return (char)('a' + (id + seq) % 26);
+}
+
+static void dream_stress_callback(
+    DreamLogLevel level,
+    const char *category,
+    const char *message,
+    const char *formatted_line,
+    void *user_data
+) {
+    DreamStressCheck *check = user_data;
+    unsigned id, seq, len;
+    int offset = 0;
+    if (strcmp(category, "Stress") != 0 ||
+        sscanf(message, "t=%u seq=%u len=%u %n", &id, &seq, &len, &offset) !=
+            3 ||
+        !offset || id >= DREAM_STRESS_THREADS) {
+        ++check->foreign;
+        return;
+    }
+    ++check->received;
+
+    const char *payload = message + offset;
+    bool whole          = len == dream_stress_length(id, seq) &&
+                 strlen(payload) == len;
+    char fill = dream_stress_fill(id, seq);
+    for (uint32_t i = 0; whole && i < len; ++i) whole = payload[i] == fill;
+    if (!whole) ++check->torn;
+
+    if (seq < check->next[id])
+        ++check->duplicated;
+    else
+        check->next[id] = seq + 1;
+}
+
+static int dream_stress_producer(void *arg) {
+    DreamStressProducer *p = arg;
+    while (!atomic_load_explicit(p->start, memory_order_acquire))
+        thrd_yield();
+
+    for (uint32_t seq = 0; seq < p->messages; ++seq) {
+        uint32_t len = dream_stress_length(p->id, seq);
+        char payload[DREAM_STRESS_MAX_PAYLOAD + 1];
+        memset(payload, dream_stress_fill(p->id, seq), len);
+        payload[len] = '\0';
+        dInfo("Stress", "t=%u seq=%u len=%u %s", p->id, seq, len, payload);
+    }
+    return 0;
+}
+
+static bool
+dream_stress_run(const DreamStressRun *run, uint32_t messages, size_t bytes) {
+    DreamStressCheck check = {0};
+    DreamLoggerSink sink   = {
+          .sink_into = DREAM_LOG_SINK_CALLBACK,
+          .min_level = DREAM_LOG_TRACE,
+    };
+    DreamLoggerSink *sinks[] = {&sink};
+    DreamLoggerConfig config = {
+        .enabled                   = true,
+        .global_min_log_level      = DREAM_LOG_TRACE,
+        .sinks                     = sinks,
+        .sink_count                = 1,
+        .callback                  = dream_stress_callback,
+        .callback_user_data        = &check,
+        .async                     = true,
+        .async_queue_bytes         = bytes,
+        .async_log_overflow_policy = run->policy,
+        .async_deferred_format     = run->deferred,
+        .async_per_thread_queues   = run->per_thread,
+        .async_thread_queue_bytes  = bytes,
+    };
+    DreamLoggerInit(&config);
+
+    atomic_bool start = false;
+    DreamStressProducer producers[DREAM_STRESS_THREADS];
+    for (uint32_t t = 0; t < DREAM_STRESS_THREADS; ++t) {
+        producers[t] = (DreamStressProducer){
+            .id       = t,
+            .messages = messages,
+            .start    = &start,
+        };
+        thrd_create(&producers[t].thread, dream_stress_producer, &producers[t]);
+    }
+    atomic_store_explicit(&start, true, memory_order_release);
+    for (uint32_t t = 0; t < DREAM_STRESS_THREADS; ++t)
+        thrd_join(producers[t].thread, nullptr);
+
+    DreamLoggerStats stats;
+    DreamLoggerGetStats(&stats);
+    DreamLoggerShutdown(); // the worker drains everything before it exits
+
+    uint64_t sent    = (uint64_t)DREAM_STRESS_THREADS * messages;
+    uint64_t dropped = stats.dropped_newest + stats.dropped_oldest;
+    bool ok          = !check.torn && !check.duplicated && !check.foreign &&
+              check.received + dropped == sent;
+    if (run->policy == BLOCK) ok = ok && check.received == sent;
+
+    fprintf(
+        stderr,
+        "%-11s %-8s %-10s received %llu/%llu, dropped %llu, torn %llu, "
+        "duplicated %llu, foreign %llu: %s\n",
+        dream_stress_policy_names[run->policy],
+        run->deferred ? "deferred" : "eager",
+        run->per_thread ? "per-thread" : "shared",
+        (unsigned long long)check.received,
+        (unsigned long long)sent,
+        (unsigned long long)dropped,
+        (unsigned long long)check.torn,
+        (unsigned long long)check.duplicated,
+        (unsigned long long)check.foreign,
+        ok ? "ok" : "FAILED"
+    );
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t messages = 50000;
+    size_t bytes      = 64 * 1024; // small, so the drop policies drop
+    int c;
+    while ((c = getopt(argc, argv, "n:q:h")) != -1) {
+        switch (c) {
+            case 'n': messages = (uint32_t)atoi(optarg); break;
+            case 'q': bytes = (size_t)atoll(optarg); break;
+            default:
+                fprintf(
+                    c == 'h' ? stdout : stderr,
+                    "usage: DreamLoggerStress [-n messages per producer] "
+                    "[-q queue bytes]\n"
+                );
+                return c == 'h' ? 0 : 2;
+        }
+    }
+
+    bool ok = true;
+    for (int policy = BLOCK; policy <= DROP_NEWEST; ++policy) {
+        for (int deferred = 0; deferred <= 1; ++deferred) {
+            for (int per_thread = 0; per_thread <= 1; ++per_thread) {
+                DreamStressRun run = {
+                    .policy     = (DreamLogAsyncOverflowPolicy)policy,
+                    .deferred   = deferred,
+                    .per_thread = per_thread,
+                };
+                ok = dream_stress_run(&run, messages, bytes) && ok;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
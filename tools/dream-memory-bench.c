@@ -0,0 +1,210 @@
+// DreamMemoryBench: DreamFrameAlloc and DreamPool against malloc/free for
+// small, short-lived allocations, on one thread and on several at once.
+// Prints one CSV row per run: workload, allocator, threads, size, ns/op.
+//
+//   frame  allocates `batch` objects, then drops them all at the end of
+//          the frame (free() each one, or DreamFrameEnd)
+//   churn  keeps `batch` objects live and replaces a pseudo-random one
+//          on every step (malloc/free or DreamPoolAlloc/DreamPoolFree)
+
+#include <Dream/Memory.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+#define DREAM_BENCH_MAX_THREADS 64
+#define DREAM_BENCH_BATCH 256
+
+static const size_t dream_bench_sizes[] = {16, 64, 256};
+#define DREAM_BENCH_SIZE_COUNT \
+    (sizeof(dream_bench_sizes) / sizeof(dream_bench_sizes[0]))
+
+typedef enum DreamBenchWorkload {
+    DREAM_BENCH_FRAME,
+    DREAM_BENCH_CHURN,
+} DreamBenchWorkload;
+
+typedef struct DreamBenchWorker {
+    thrd_t thread;
+    DreamBenchWorkload workload;
+    bool dream; // else malloc/free
+    size_t size;
+    uint32_t ops;
+    DreamPool *pool;
+    atomic_bool *start;
+    uint64_t checksum; // keeps the stores alive
+} DreamBenchWorker;
+
+static uint64_t dream_bench_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void dream_bench_touch(DreamBenchWorker *w, void *p, uint32_t i) {
+    *(volatile uint32_t *)p = i;
+    w->checksum += (uintptr_t)p & 0xff;
+}
+
+static void dream_bench_frame(DreamBenchWorker *w) {
+    void *live[DREAM_BENCH_BATCH];
+    for (uint32_t done = 0; done < w->ops; done += DREAM_BENCH_BATCH) {
+        for (uint32_t i = 0; i < DREAM_BENCH_BATCH; ++i) {
+            live[i] = w->dream ? DreamFrameAlloc(w->size, 0) : malloc(w->size);
+            dream_bench_touch(w, live[i], i);
+        }
+        // Frames end on one thread in a game; here every worker ends its
+        // own, which only makes the others rewind a little early.
+        if (w->dream)
+            DreamFrameEnd();
+        else
+            for (uint32_t i = 0; i < DREAM_BENCH_BATCH; ++i) free(live[i]);
+    }
+}
+
+static void dream_bench_churn(DreamBenchWorker *w) {
+    void *live[DREAM_BENCH_BATCH];
+    for (uint32_t i = 0; i < DREAM_BENCH_BATCH; ++i)
+        live[i] = w->dream ? DreamPoolAlloc(w->pool) : malloc(w->size);
+
+    uint32_t x = 2463534242u;
+    for (uint32_t i = 0; i < w->ops; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        uint32_t slot = x % DREAM_BENCH_BATCH;
+        if (w->dream) {
+            DreamPoolFree(w->pool, live[slot]);
+            live[slot] = DreamPoolAlloc(w->pool);
+        } else {
+            free(live[slot]);
+            live[slot] = malloc(w->size);
+        }
+        dream_bench_touch(w, live[slot], i);
+    }
+
+    for (uint32_t i = 0; i < DREAM_BENCH_BATCH; ++i) {
+        if (w->dream)
+            DreamPoolFree(w->pool, live[i]);
+        else
+            free(live[i]);
+    }
+}
+
+static int dream_bench_worker(void *arg) {
+    DreamBenchWorker *w = arg;
+    while (!atomic_load_explicit(w->start, memory_order_acquire)) {
+    }
+    if (w->workload == DREAM_BENCH_FRAME)
+        dream_bench_frame(w);
+    else
+        dream_bench_churn(w);
+    return 0;
+}
+
+// Returns ns per allocation, averaged over the threads.
+static double dream_bench_run(
+    DreamBenchWorkload workload,
+    bool dream,
+    uint32_t threads,
+    size_t size,
+    uint32_t ops
+) {
+    static DreamBenchWorker workers[DREAM_BENCH_MAX_THREADS];
+    atomic_bool start = false;
+    DreamPool *pool   = nullptr;
+    if (dream && workload == DREAM_BENCH_CHURN)
+        pool = DreamPoolCreate(size, 0);
+
+    for (uint32_t i = 0; i < threads; ++i) {
+        workers[i] = (DreamBenchWorker){
+            .workload = workload,
+            .dream    = dream,
+            .size     = size,
+            .ops      = ops,
+            .pool     = pool,
+            .start    = &start,
+        };
+        thrd_create(&workers[i].thread, dream_bench_worker, &workers[i]);
+    }
+    uint64_t begin = dream_bench_ns();
+    atomic_store_explicit(&start, true, memory_order_release);
+    uint64_t checksum = 0;
+    for (uint32_t i = 0; i < threads; ++i) {
+        thrd_join(workers[i].thread, nullptr);
+        checksum += workers[i].checksum;
+    }
+    uint64_t elapsed = dream_bench_ns() - begin;
+    DreamPoolDestroy(pool);
+    if (checksum == 1) fputc('\0', stderr); // never, but not provably
+    return (double)elapsed / ops;
+}
+
+static void dream_bench_usage(FILE *out) {
+    fputs(
+        "usage: DreamMemoryBench [-n ops] [-t max_threads] [-o file.csv]\n"
+        "  -n  allocations per thread and run (default 4000000)\n"
+        "  -t  runs with 1, 2, 4, ... up to this many threads (default 4)\n"
+        "  -o  write the CSV here instead of stdout\n",
+        out
+    );
+}
+
+int main(int argc, char **argv) {
+    uint32_t ops         = 4000000;
+    uint32_t max_threads = 4;
+    const char *output   = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            ops = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            max_threads = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            dream_bench_usage(strcmp(argv[i], "-h") ? stderr : stdout);
+            return strcmp(argv[i], "-h") ? 1 : 0;
+        }
+    }
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > DREAM_BENCH_MAX_THREADS)
+        max_threads = DREAM_BENCH_MAX_THREADS;
+    ops = (ops + DREAM_BENCH_BATCH - 1) / DREAM_BENCH_BATCH * DREAM_BENCH_BATCH;
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    fputs("workload,allocator,threads,size,ns_per_op\n", out);
+    static const char *workloads[] = {"frame", "churn"};
+    static const char *dream_names[] = {"frame_arena", "pool"};
+    for (int workload = DREAM_BENCH_FRAME; workload <= DREAM_BENCH_CHURN;
+         ++workload) {
+        for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+            for (size_t s = 0; s < DREAM_BENCH_SIZE_COUNT; ++s) {
+                for (int dream = 0; dream <= 1; ++dream) {
+                    double ns = dream_bench_run(
+                        workload, dream, threads, dream_bench_sizes[s], ops
+                    );
+                    fprintf(
+                        out,
+                        "%s,%s,%u,%zu,%.2f\n",
+                        workloads[workload],
+                        dream ? dream_names[workload] : "malloc",
+                        threads,
+                        dream_bench_sizes[s],
+                        ns
+                    );
+                    fflush(out);
+                }
+            }
+        }
+    }
+    if (out != stdout) fclose(out);
+    return 0;
+}